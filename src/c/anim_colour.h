@@ -1,11 +0,0 @@
-/*
-This Source Code Form is subject to the terms of the Mozilla Public
-License, v. 2.0. If a copy of the MPL was not distributed with this
-file, You can obtain one at https://mozilla.org/MPL/2.0/.
-*/
-
-#pragma once
-
-#include <pebble.h>
-
-Animation* create_anim_bg_colour(Window* window, GColor* next_color);
\ No newline at end of file
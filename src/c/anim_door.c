@@ -0,0 +1,54 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <pebble.h>
+#include "anim_door.h"
+#include "invalidate.h"
+
+#define DOOR_FRAME_DURATION_MS 13
+
+typedef struct {
+    int* frame_index;
+    DoorFrameCountGetter get_num_frames;
+} DoorAnimState;
+
+// one at a time is enough, since a new scroll replaces the frame index anyway
+static DoorAnimState s_open_state;
+
+static void set_frame_index(DoorAnimState* state, int frame_index) {
+    if (*state->frame_index != frame_index) {
+        *state->frame_index = frame_index;
+        invalidate_mark(DirtyVehicleFrame);
+    }
+}
+
+/*
+The vehicle (and so the number of frames) can change between creating
+the animation and running it, so it's looked up on every update
+*/
+static void door_open_update(Animation* animation, const AnimationProgress progress) {
+    DoorAnimState* state = animation_get_context(animation);
+    const int last_frame = (int)state->get_num_frames() - 1;
+    set_frame_index(state, last_frame * (int)progress / ANIMATION_NORMALIZED_MAX);
+}
+
+static const AnimationImplementation s_door_open_impl = {
+    .update = door_open_update,
+};
+
+Animation* create_anim_door_open(int* frame_index, DoorFrameCountGetter get_num_frames, uint32_t num_frames) {
+    s_open_state = (DoorAnimState) {
+        .frame_index = frame_index,
+        .get_num_frames = get_num_frames,
+    };
+    Animation* anim = animation_create();
+    animation_set_implementation(anim, &s_door_open_impl);
+    animation_set_handlers(anim, (AnimationHandlers) { .stopped = NULL }, &s_open_state);
+    // one frame time per step, so every vehicle's door opens at the same pace
+    animation_set_duration(anim, DOOR_FRAME_DURATION_MS * (num_frames > 1 ? num_frames - 1 : 0));
+    animation_set_curve(anim, AnimationCurveLinear);
+    return anim;
+}
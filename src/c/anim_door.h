@@ -0,0 +1,18 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+
+typedef uint32_t (*DoorFrameCountGetter)(void);
+
+/*
+Step `*frame_index` from the first frame to the last of the current
+vehicle's sequence. `num_frames` is how many frames the vehicle it's
+expected to run for has, and sets how long it takes.
+*/
+Animation* create_anim_door_open(int* frame_index, DoorFrameCountGetter get_num_frames, uint32_t num_frames);
@@ -7,6 +7,7 @@ file, You can obtain one at https://mozilla.org/MPL/2.0/.
 #include <pebble.h>
 #include "anim_number.h"
 #include "data.h"
+#include "invalidate.h"
 
 #define NUMBER_ANIM_DURATION_MS 260
 
@@ -21,22 +22,17 @@ static int16_t number_getter(void* context) {
 static void number_setter(void* context, int16_t time) {
     Window* window = (Window*)context;
     WindowDataArray* data_array = window_get_user_data(window);
-    if (data_array->anim_intermediates.time == NULL) {
-        data_array->anim_intermediates.time = malloc(sizeof(int16_t));
-    }
-    *(data_array->anim_intermediates.time) = time;
+    data_array->anim_intermediates.time = time;
+    data_array->anim_intermediates.has_time = true;
     set_time_text(data_array);
-    layer_mark_dirty(window_get_root_layer(window));
+    invalidate_mark(DirtyTime);
 }
 
 static void cleanup_intermediate_number(Animation* animation) {
     Window* window;
     property_animation_get_subject((PropertyAnimation*)animation, (void*)&window);
     WindowDataArray* data_array = window_get_user_data(window);
-    if (data_array->anim_intermediates.time != NULL) {
-        free(data_array->anim_intermediates.time);
-        data_array->anim_intermediates.time = NULL;
-    }
+    data_array->anim_intermediates.has_time = false;
 }
 
 static const PropertyAnimationImplementation s_anim_number_impl = {
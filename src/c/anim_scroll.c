@@ -0,0 +1,222 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <pebble.h>
+#include "anim_scroll.h"
+#include "data.h"
+#include "invalidate.h"
+
+// timeline of the transition, in ms
+#define TEXT_OUT_START 0
+#define TEXT_OUT_DURATION 260
+#define TEXT_IN_START 260
+#define TEXT_IN_DURATION 260
+#define VEHICLE_OUT_START 260
+#define VEHICLE_OUT_DURATION 200
+#define VEHICLE_IN_START 460
+#define VEHICLE_IN_DURATION 200
+#define COLOUR_START 0
+#define COLOUR_DURATION 460
+#define NUMBER_START 100
+#define NUMBER_DURATION 260
+#define DOOR_FRAME_DURATION 13
+#define SCROLL_ANIM_DURATION 660
+
+#define TEXT_DIST_OUT 40
+#define TEXT_DIST_IN 16
+#define VEHICLE_DIST 40
+
+void set_time_text(WindowDataArray*);
+
+/*
+Curves sampled at 17 points as 0.16 fixed point fractions
+(0..ANIMATION_NORMALIZED_MAX, i.e. 0..65535) and linearly interpolated
+between
+*/
+typedef uint16_t Curve[17];
+
+static const Curve s_linear = {
+    0, 4096, 8192, 12288, 16384, 20480, 24576, 28672, 32768, 36864, 40960, 45056, 49152, 53248, 57344, 61440, 65535
+};
+static const Curve s_ease_in = {
+    0, 256, 1024, 2304, 4096, 6400, 9216, 12544, 16384, 20736, 25600, 30976, 36863, 43263, 50175, 57599, 65535
+};
+static const Curve s_ease_out = {
+    0, 7936, 15360, 22272, 28672, 34559, 39935, 44799, 49151, 52991, 56319, 59135, 61439, 63231, 64511, 65279, 65535
+};
+static const Curve s_ease_in_out = {
+    0, 512, 2048, 4608, 8192, 12800, 18432, 25088, 32768, 40447, 47103, 52735, 57343, 60927, 63487, 65023, 65535
+};
+
+typedef struct {
+    WindowDataArray* data_array;
+    Layer* description_layer;
+    Layer* vehicle_layer;
+    int* vehicle_frame_index;
+    ScrollMidpointHandler midpoint;
+    int16_t text_out_dy;
+    int16_t text_in_dy;
+    int16_t vehicle_out_dy;
+    int16_t vehicle_in_dy;
+    GColor from_color;
+    GColor to_color;
+    int16_t from_time;
+    int16_t to_time;
+    int door_from_index;
+    bool reached_midpoint;
+} ScrollAnimState;
+
+// only one scroll runs at a time, so its state is allocated once
+static ScrollAnimState s_state;
+
+static uint32_t apply_curve(const Curve curve, uint32_t progress) {
+    if (progress >= ANIMATION_NORMALIZED_MAX) {
+        return ANIMATION_NORMALIZED_MAX;
+    }
+    const uint32_t index = progress >> 12;
+    const uint32_t frac = progress & 0xfff;
+    return curve[index] + (((int32_t)curve[index + 1] - (int32_t)curve[index]) * (int32_t)frac >> 12);
+}
+
+/*
+Progress of the part of the timeline starting at `start` and lasting
+`duration`, clamped to 0..ANIMATION_NORMALIZED_MAX
+*/
+static uint32_t phase(uint32_t elapsed, uint32_t start, uint32_t duration, const Curve curve) {
+    if (elapsed <= start) {
+        return 0;
+    } else if (elapsed >= start + duration) {
+        return ANIMATION_NORMALIZED_MAX;
+    }
+    return apply_curve(curve, (elapsed - start) * ANIMATION_NORMALIZED_MAX / duration);
+}
+
+static int16_t lerp(int16_t from, int16_t to, uint32_t progress) {
+    return from + (int16_t)(((int32_t)(to - from) * (int32_t)progress) / ANIMATION_NORMALIZED_MAX);
+}
+
+static GColor lerp_color(GColor from, GColor to, uint32_t progress) {
+    return (GColor) {
+        .a = lerp(from.a, to.a, progress),
+        .r = lerp(from.r, to.r, progress),
+        .g = lerp(from.g, to.g, progress),
+        .b = lerp(from.b, to.b, progress),
+    };
+}
+
+static void set_origin_y(Layer* layer, int16_t y) {
+    GRect bounds = layer_get_bounds(layer);
+    if (bounds.origin.x != 0 || bounds.origin.y != y) {
+        layer_set_bounds(layer, GRect(0, y, bounds.size.w, bounds.size.h));
+    }
+}
+
+static void scroll_setup(Animation* animation) {
+    ScrollAnimState* state = animation_get_context(animation);
+    state->door_from_index = *state->vehicle_frame_index;
+    state->reached_midpoint = false;
+}
+
+static void scroll_update(Animation* animation, const AnimationProgress progress) {
+    ScrollAnimState* state = animation_get_context(animation);
+    AnimIntermediates* intermediates = &state->data_array->anim_intermediates;
+    const uint32_t elapsed = progress * SCROLL_ANIM_DURATION / ANIMATION_NORMALIZED_MAX;
+
+    // text goes out, the entry changes, then it comes back in from the other side
+    if (elapsed < TEXT_IN_START) {
+        set_origin_y(state->description_layer,
+            lerp(0, state->text_out_dy, phase(elapsed, TEXT_OUT_START, TEXT_OUT_DURATION, s_ease_in)));
+    } else {
+        if (!state->reached_midpoint) {
+            state->reached_midpoint = true;
+            state->midpoint();
+        }
+        set_origin_y(state->description_layer,
+            lerp(state->text_in_dy, 0, phase(elapsed, TEXT_IN_START, TEXT_IN_DURATION, s_ease_out)));
+    }
+
+    if (elapsed < VEHICLE_IN_START) {
+        set_origin_y(state->vehicle_layer,
+            lerp(0, state->vehicle_out_dy, phase(elapsed, VEHICLE_OUT_START, VEHICLE_OUT_DURATION, s_linear)));
+    } else {
+        set_origin_y(state->vehicle_layer,
+            lerp(state->vehicle_in_dy, 0, phase(elapsed, VEHICLE_IN_START, VEHICLE_IN_DURATION, s_ease_out)));
+    }
+
+    // the door is fully closed by the time the vehicle has left
+    int frame_index = 0;
+    if (elapsed < VEHICLE_IN_START && state->door_from_index > 0) {
+        frame_index = lerp(state->door_from_index, 0,
+            phase(elapsed, 0, state->door_from_index * DOOR_FRAME_DURATION, s_linear));
+    }
+    if (*state->vehicle_frame_index != frame_index) {
+        *state->vehicle_frame_index = frame_index;
+        invalidate_mark(DirtyVehicleFrame);
+    }
+
+    GColor color = lerp_color(state->from_color, state->to_color,
+        phase(elapsed, COLOUR_START, COLOUR_DURATION, s_ease_in_out));
+    if (!intermediates->has_color || !gcolor_equal(intermediates->color, color)) {
+        intermediates->color = color;
+        intermediates->has_color = true;
+        invalidate_mark(DirtyColor);
+    }
+
+    int16_t time = lerp(state->from_time, state->to_time,
+        phase(elapsed, NUMBER_START, NUMBER_DURATION, s_ease_in_out));
+    if (!intermediates->has_time || intermediates->time != time) {
+        intermediates->time = time;
+        intermediates->has_time = true;
+        set_time_text(state->data_array);
+        invalidate_mark(DirtyTime);
+    }
+}
+
+static void scroll_teardown(Animation* animation) {
+    ScrollAnimState* state = animation_get_context(animation);
+    set_origin_y(state->description_layer, 0);
+    set_origin_y(state->vehicle_layer, 0);
+    state->data_array->anim_intermediates.has_color = false;
+    state->data_array->anim_intermediates.has_time = false;
+    set_time_text(state->data_array);
+    invalidate_mark(DirtyColor | DirtyTime);
+}
+
+static const AnimationImplementation s_scroll_impl = {
+    .setup = scroll_setup,
+    .update = scroll_update,
+    .teardown = scroll_teardown,
+};
+
+Animation* create_anim_scroll(WindowDataArray* data_array, Layer* description_layer, Layer* vehicle_layer,
+        int* vehicle_frame_index, int steps, ScrollMidpointHandler midpoint) {
+    const bool down = steps > 0;
+    WindowData* next = window_data_offset(data_array, steps);
+    s_state = (ScrollAnimState) {
+        .data_array = data_array,
+        .description_layer = description_layer,
+        .vehicle_layer = vehicle_layer,
+        .vehicle_frame_index = vehicle_frame_index,
+        .midpoint = midpoint,
+        .text_out_dy = down ? -TEXT_DIST_OUT : TEXT_DIST_OUT,
+        .text_in_dy = down ? TEXT_DIST_IN : -TEXT_DIST_IN,
+        .vehicle_out_dy = down ? -VEHICLE_DIST : VEHICLE_DIST,
+        .vehicle_in_dy = down ? VEHICLE_DIST : -VEHICLE_DIST,
+        .from_color = *get_display_gcolor(data_array),
+        .to_color = next->color,
+        .from_time = *get_display_time(data_array),
+        .to_time = next->time,
+        .door_from_index = *vehicle_frame_index,
+        .reached_midpoint = false,
+    };
+
+    Animation* anim = animation_create();
+    animation_set_implementation(anim, &s_scroll_impl);
+    animation_set_handlers(anim, (AnimationHandlers) { .stopped = NULL }, &s_state);
+    animation_set_duration(anim, SCROLL_ANIM_DURATION);
+    animation_set_curve(anim, AnimationCurveLinear);
+    return anim;
+}
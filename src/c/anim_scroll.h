@@ -0,0 +1,21 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+#include "data.h"
+
+typedef void (*ScrollMidpointHandler)(void);
+
+/*
+The whole scroll transition as one animation: text out and in, vehicle
+out and in, door closing, side bar colour and the time, all driven from
+one progress value. `midpoint` is called once the text is out of view,
+which is when the current entry should change.
+*/
+Animation* create_anim_scroll(WindowDataArray* data_array, Layer* description_layer, Layer* vehicle_layer,
+    int* vehicle_frame_index, int steps, ScrollMidpointHandler midpoint);
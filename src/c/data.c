@@ -6,6 +6,125 @@ file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
 #include "data.h"
 
+static char s_empty_string[] = "";
+
+static void window_data_clear(WindowData* data) {
+    *data = (WindowData) {
+        .id = 0,
+        .arrival = 0,
+        .time = 0,
+        .num_next = 0,
+        .unit = s_empty_string,
+        .stop_name = s_empty_string,
+        .dest_name = s_empty_string,
+        .route_number = s_empty_string,
+        .route_name = s_empty_string,
+        .vehicle_type = STREETCAR,
+        .color = GColorRed,
+        .shape = ROUNDRECT,
+        .route_layout_valid = false,
+        .next_group_start = 0,
+    };
+}
+
+bool window_data_array_init(WindowDataArray* array, int capacity, size_t string_pool_size) {
+    char* arena = malloc(capacity * sizeof(WindowData) + string_pool_size);
+    if (arena == NULL) {
+        return false;
+    }
+    array->array = (WindowData*)arena;
+    array->capacity = capacity;
+    array->string_pool = arena + capacity * sizeof(WindowData);
+    array->string_pool_size = string_pool_size;
+    window_data_array_reset(array);
+    return true;
+}
+
+/*
+Forget all the stored strings and point every entry back at the empty
+string, so nothing is left pointing at stale pool contents
+*/
+void window_data_array_reset(WindowDataArray* array) {
+    array->seq = 0;
+    array->partial = false;
+    array->more_coming = false;
+    array->window_offset = 0;
+    array->total = 0;
+    array->num_groups = 0;
+    array->string_pool_used = 0;
+    for (int i = 0; i < array->capacity; i += 1) {
+        window_data_clear(&array->array[i]);
+    }
+}
+
+/*
+The entries and the string pool are one allocation, so this is the
+only free needed
+*/
+void window_data_array_deinit(WindowDataArray* array) {
+    free(array->array);
+    array->array = NULL;
+    array->string_pool = NULL;
+    array->capacity = 0;
+    array->string_pool_size = 0;
+    array->string_pool_used = 0;
+}
+
+/*
+Copy `len` bytes of `str` into the string pool and NUL-terminate it.
+If the pool is full the string is dropped and the empty string is
+returned instead, so callers never have to check for NULL
+*/
+char* window_data_store_string(WindowDataArray* array, const char* str, size_t len) {
+    if (array->string_pool_used + len + 1 > array->string_pool_size) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "String pool full, dropping string of length %d", (int)len);
+        return s_empty_string;
+    }
+    char* result = array->string_pool + array->string_pool_used;
+    memcpy(result, str, len);
+    result[len] = 0;
+    array->string_pool_used += len + 1;
+    return result;
+}
+
+/*
+Like window_data_store_string, but if an identical string is already in
+the pool that copy is returned instead, so entries sharing a stop or
+route name also share the pointer
+*/
+char* window_data_intern_string(WindowDataArray* array, const char* str, size_t len) {
+    if (len == 0) {
+        return s_empty_string;
+    }
+    char* pos = array->string_pool;
+    char* end = array->string_pool + array->string_pool_used;
+    while (pos < end) {
+        size_t pos_len = strlen(pos);
+        if (pos_len == len && memcmp(pos, str, len) == 0) {
+            return pos;
+        }
+        pos += pos_len + 1;
+    }
+    return window_data_store_string(array, str, len);
+}
+
+size_t window_data_string_pool_free(WindowDataArray* array) {
+    return array->string_pool_size - array->string_pool_used;
+}
+
+/*
+Index of the departure with the given id among the first data_len
+entries, or -1 if there isn't one
+*/
+int window_data_find(WindowDataArray* array, uint16_t id) {
+    for (int i = 0; i < array->data_len; i += 1) {
+        if (array->array[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 WindowData* window_data_current(WindowDataArray* array) {
     return &array->array[array->data_index];
 }
@@ -55,13 +174,113 @@ int window_data_can_dec(WindowDataArray* array) {
     }
 }
 
+/*
+The entry `offset` away from the current one; like window_data_next,
+this assumes the offset has already been clamped
+*/
+WindowData* window_data_offset(WindowDataArray* array, int offset) {
+    return &array->array[array->data_index + offset];
+}
+
+/*
+Limit a number of steps (negative meaning up) to what's actually
+available from the current entry
+*/
+int window_data_clamp_steps(WindowDataArray* array, int steps) {
+    if (array->data_len <= 0) {
+        return 0;
+    }
+    if (array->data_index + steps > array->data_len - 1) {
+        return array->data_len - 1 - array->data_index;
+    }
+    if (array->data_index + steps < 0) {
+        return -array->data_index;
+    }
+    return steps;
+}
+
+/*
+Group the entries by stop, in the order each stop first appears, and
+point every entry at the first entry of the group after its own,
+wrapping around to the first group. Stop names are interned, so they
+are compared by pointer. Needs redoing whenever the entries change.
+*/
+void window_data_index_groups(WindowDataArray* array) {
+    uint8_t group_starts[array->data_len > 0 ? array->data_len : 1];
+    uint8_t groups[array->data_len > 0 ? array->data_len : 1];
+    int num_groups = 0;
+    for (int i = 0; i < array->data_len; i += 1) {
+        int group = 0;
+        while (group < num_groups && array->array[group_starts[group]].stop_name != array->array[i].stop_name) {
+            group += 1;
+        }
+        if (group == num_groups) {
+            group_starts[num_groups] = i;
+            num_groups += 1;
+        }
+        groups[i] = group;
+    }
+    for (int i = 0; i < array->data_len; i += 1) {
+        array->array[i].next_group_start = group_starts[(groups[i] + 1) % num_groups];
+    }
+    array->num_groups = num_groups;
+}
+
+/*
+Steps from the current entry to the first entry at the next stop, which
+is negative when that wraps around to the top. 0 if all the entries
+are at the same stop.
+*/
+int window_data_next_group_steps(WindowDataArray* array) {
+    if (array->data_len <= 0 || array->num_groups < 2) {
+        return 0;
+    }
+    return window_data_current(array)->next_group_start - array->data_index;
+}
+
+/*
+Recompute the minutes until each departure from its arrival time.
+Departures that are due or past show 0 until the phone drops them.
+Returns whether any of them changed.
+*/
+bool window_data_update_times(WindowDataArray* array, time_t now) {
+    bool changed = false;
+    for (int i = 0; i < array->data_len; i += 1) {
+        WindowData* data = &array->array[i];
+        int16_t time = 0;
+        if ((time_t)data->arrival > now) {
+            time = (int16_t)((data->arrival - now) / SECONDS_PER_MINUTE);
+        }
+        if (data->time != time) {
+            data->time = time;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/*
+Minutes until each of the later arrivals. These are counted from
+`arrival` rather than from `time`, which stops at 0, so they keep
+counting down once the first one has gone. `times` needs room for
+MAX_NEXT_ARRIVALS. Returns how many there are.
+*/
+int window_data_next_times(WindowData* data, time_t now, int16_t* times) {
+    int32_t minutes = ((int32_t)data->arrival - (int32_t)now) / SECONDS_PER_MINUTE;
+    for (int i = 0; i < data->num_next; i += 1) {
+        minutes += data->next_gaps[i];
+        times[i] = (int16_t)(minutes > 0 ? minutes : 0);
+    }
+    return data->num_next;
+}
+
 /*
 Get the colour that should currently be displayed on the side
 bar, either the set colour or an animation intermediate
 */
 GColor* get_display_gcolor(WindowDataArray* array) {
-    if (array->anim_intermediates.color != NULL) {
-        return array->anim_intermediates.color;
+    if (array->anim_intermediates.has_color) {
+        return &(array->anim_intermediates.color);
     } else {
         WindowData* data = window_data_current(array);
         return &(data->color);
@@ -69,8 +288,8 @@ GColor* get_display_gcolor(WindowDataArray* array) {
 }
 
 int16_t* get_display_time(WindowDataArray* array) {
-    if (array->anim_intermediates.time != NULL) {
-        return array->anim_intermediates.time;
+    if (array->anim_intermediates.has_time) {
+        return &(array->anim_intermediates.time);
     } else {
         WindowData* data = window_data_current(array);
         return &(data->time);
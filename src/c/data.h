@@ -8,6 +8,9 @@ file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
 #include <pebble.h>
 
+// later arrivals kept for each departure, MAX_NEXT_ARRIVALS in src/pkjs/message.js
+#define MAX_NEXT_ARRIVALS 3
+
 typedef enum {
     ScrollDirectionDown,
     ScrollDirectionUp,
@@ -38,8 +41,26 @@ typedef enum {
     COULD_NOT_DECODE_MESSAGE = -8,
 } Error;
 
+/*
+Where the route pill, the route number inside it and the route name go
+within the route layer (see route_layout.c)
+*/
+typedef struct {
+    GRect pill_bounds;
+    GRect number_bounds;
+    GRect name_bounds;
+} RouteLayout;
+
 typedef struct {
+    uint16_t id;
+    // seconds since the epoch, as sent by the phone
+    uint32_t arrival;
+    // whole minutes until `arrival`, kept up to date by window_data_update_times
     int16_t time;
+    // minutes from each later arrival to the one before it, the first
+    // counting from `arrival`
+    uint8_t next_gaps[MAX_NEXT_ARRIVALS];
+    uint8_t num_next;
     char* unit;
     char* stop_name;
     char* dest_name;
@@ -48,20 +69,61 @@ typedef struct {
     VehicleType vehicle_type;
     GColor color;
     RouteShape shape;
+    // measured once per departure, since text measurement is slow
+    RouteLayout route_layout;
+    bool route_layout_valid;
+    // index of the first entry at the next stop, see window_data_index_groups
+    uint8_t next_group_start;
 } WindowData;
 
+/*
+Values shown while a scroll is between two entries. Stored inline so a
+transition never touches the heap
+*/
 typedef struct {
-    GColor* color;
-    int16_t* time;
+    GColor color;
+    int16_t time;
+    bool has_color;
+    bool has_time;
 } AnimIntermediates;
 
+/*
+WindowData entries and the strings they point to live in a single
+arena: `capacity` WindowData structs followed by a packed pool of
+NUL-terminated strings. The pool is reset (not freed) whenever a new
+set of departures arrives.
+*/
 typedef struct {
     WindowData* array;
     int data_len;
     int data_index;
     AnimIntermediates anim_intermediates;
+    // sequence number of the departures last received from the phone, 0 if none
+    uint16_t seq;
+    // some stops didn't answer the phone in time
+    bool partial;
+    // the phone is still sending departures
+    bool more_coming;
+    // the entries are a window of the phone's list, starting at window_offset
+    // in a list of `total`
+    uint16_t window_offset;
+    uint16_t total;
+    // how many different stops the entries are at
+    uint8_t num_groups;
+    int capacity;
+    char* string_pool;
+    size_t string_pool_size;
+    size_t string_pool_used;
 } WindowDataArray;
 
+bool window_data_array_init(WindowDataArray*, int capacity, size_t string_pool_size);
+void window_data_array_reset(WindowDataArray*);
+void window_data_array_deinit(WindowDataArray*);
+char* window_data_store_string(WindowDataArray*, const char* str, size_t len);
+char* window_data_intern_string(WindowDataArray*, const char* str, size_t len);
+size_t window_data_string_pool_free(WindowDataArray*);
+int window_data_find(WindowDataArray*, uint16_t id);
+
 WindowData* window_data_current(WindowDataArray*);
 WindowData* window_data_next(WindowDataArray*);
 WindowData* window_data_prev(WindowDataArray*);
@@ -69,5 +131,11 @@ int window_data_inc(WindowDataArray*);
 int window_data_dec(WindowDataArray*);
 int window_data_can_inc(WindowDataArray*);
 int window_data_can_dec(WindowDataArray*);
+WindowData* window_data_offset(WindowDataArray*, int offset);
+int window_data_clamp_steps(WindowDataArray*, int steps);
+void window_data_index_groups(WindowDataArray*);
+int window_data_next_group_steps(WindowDataArray*);
+bool window_data_update_times(WindowDataArray*, time_t now);
+int window_data_next_times(WindowData*, time_t now, int16_t* times);
 GColor* get_display_gcolor(WindowDataArray*);
 int16_t* get_display_time(WindowDataArray*);
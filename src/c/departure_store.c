@@ -0,0 +1,88 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <pebble.h>
+#include "departure_store.h"
+#include "data.h"
+#include "message.h"
+
+// stay well inside the 4 KB an app gets in total
+#define MAX_CHUNKS 8
+#define MAX_STORED_BYTES (MAX_CHUNKS * PERSIST_DATA_MAX_LENGTH)
+// older than this and most of the departures will have left
+#define MAX_AGE_SECONDS (30 * SECONDS_PER_MINUTE)
+
+typedef enum {
+    PersistKeyLength = 1,
+    PersistKeySavedAt = 2,
+    PersistKeyFirstChunk = 16,
+} PersistKey;
+
+static void delete_stored(void) {
+    const int length = persist_read_int(PersistKeyLength);
+    for (int i = 0; i * PERSIST_DATA_MAX_LENGTH < length && i < MAX_CHUNKS; i += 1) {
+        persist_delete(PersistKeyFirstChunk + i);
+    }
+    persist_delete(PersistKeyLength);
+    persist_delete(PersistKeySavedAt);
+}
+
+void departure_store_save(WindowDataArray* array) {
+    uint8_t* buffer = malloc(MAX_STORED_BYTES);
+    if (buffer == NULL) {
+        return;
+    }
+    const size_t length = message_encode_snapshot(array, buffer, MAX_STORED_BYTES);
+    delete_stored();
+    if (length == 0) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Departures too big to store");
+        free(buffer);
+        return;
+    }
+    for (size_t offset = 0; offset < length; offset += PERSIST_DATA_MAX_LENGTH) {
+        const size_t chunk = length - offset < PERSIST_DATA_MAX_LENGTH ? length - offset : PERSIST_DATA_MAX_LENGTH;
+        persist_write_data(PersistKeyFirstChunk + offset / PERSIST_DATA_MAX_LENGTH, buffer + offset, chunk);
+    }
+    // written last, so a partly written set is never read back
+    persist_write_int(PersistKeySavedAt, time(NULL));
+    persist_write_int(PersistKeyLength, length);
+    free(buffer);
+}
+
+bool departure_store_load(WindowDataArray* array) {
+    const int length = persist_exists(PersistKeyLength) ? persist_read_int(PersistKeyLength) : 0;
+    if (length <= 0 || length > MAX_STORED_BYTES) {
+        return false;
+    }
+    const time_t age = time(NULL) - persist_read_int(PersistKeySavedAt);
+    if (age < 0 || age > MAX_AGE_SECONDS) {
+        return false;
+    }
+
+    uint8_t* buffer = malloc(length);
+    if (buffer == NULL) {
+        return false;
+    }
+    for (int offset = 0; offset < length; offset += PERSIST_DATA_MAX_LENGTH) {
+        const int chunk = length - offset < PERSIST_DATA_MAX_LENGTH ? length - offset : PERSIST_DATA_MAX_LENGTH;
+        if (persist_read_data(PersistKeyFirstChunk + offset / PERSIST_DATA_MAX_LENGTH, buffer + offset, chunk) != chunk) {
+            free(buffer);
+            return false;
+        }
+    }
+    MessageType type;
+    const DecodeResult result = message_decode_departures(array, buffer, length, &type);
+    free(buffer);
+    if (result != DecodeResultUpdated || array->data_len <= 0) {
+        window_data_array_reset(array);
+        array->data_len = LOADING;
+        return false;
+    }
+    // the phone doesn't know about these, so any delta has to start from a snapshot
+    array->seq = 0;
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Loaded %d stored departures, %d s old", array->data_len, (int)age);
+    return true;
+}
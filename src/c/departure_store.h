@@ -0,0 +1,21 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+#include "data.h"
+
+/*
+Keeps the last departures in persistent storage so they can be shown
+straight away on the next launch, while the phone is still finding
+stops. They're stored as a snapshot message (see message.h) split over
+as many persist keys as it needs. Arrival times are absolute, so the
+countdown is still right when they're loaded again.
+*/
+void departure_store_save(WindowDataArray*);
+// returns false if nothing usable was saved, leaving the array as it was
+bool departure_store_load(WindowDataArray*);
@@ -0,0 +1,42 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <pebble.h>
+#include "invalidate.h"
+
+#define MAX_DEPENDENT_LAYERS 12
+
+typedef struct {
+    Layer* layer;
+    DirtyFlags depends_on;
+} DependentLayer;
+
+static DependentLayer s_layers[MAX_DEPENDENT_LAYERS];
+static int s_num_layers = 0;
+
+void invalidate_register(Layer* layer, DirtyFlags depends_on) {
+    if (s_num_layers == MAX_DEPENDENT_LAYERS) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Too many layers registered for invalidation");
+        return;
+    }
+    s_layers[s_num_layers] = (DependentLayer) {
+        .layer = layer,
+        .depends_on = depends_on,
+    };
+    s_num_layers += 1;
+}
+
+void invalidate_unregister_all(void) {
+    s_num_layers = 0;
+}
+
+void invalidate_mark(DirtyFlags flags) {
+    for (int i = 0; i < s_num_layers; i += 1) {
+        if (s_layers[i].depends_on & flags) {
+            layer_mark_dirty(s_layers[i].layer);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+
+/*
+What changed, so only the layers that draw it get marked dirty
+*/
+typedef enum {
+    // the displayed time, including the number animation intermediate
+    DirtyTime = 1 << 0,
+    // the side bar colour, including the colour animation intermediate
+    DirtyColor = 1 << 1,
+    // the door animation frame
+    DirtyVehicleFrame = 1 << 2,
+    // anything else about the current departure
+    DirtyDeparture = 1 << 3,
+    // loading/error state
+    DirtyStatus = 1 << 4,
+    DirtyAll = (1 << 5) - 1,
+} DirtyFlags;
+
+void invalidate_register(Layer* layer, DirtyFlags depends_on);
+void invalidate_unregister_all(void);
+void invalidate_mark(DirtyFlags flags);
@@ -5,16 +5,20 @@ file, You can obtain one at https://mozilla.org/MPL/2.0/.
 */
 
 #include <pebble.h>
-#include "anim_colour.h"
+#include "anim_door.h"
 #include "anim_number.h"
-#include "anim_vehicle.h"
+#include "anim_scroll.h"
 #include "data.h"
+#include "departure_store.h"
+#include "invalidate.h"
+#include "message.h"
+#include "refresh.h"
+#include "resource_cache.h"
+#include "route_layout.h"
 
 #define RIGHT_BAR_WIDTH 50
-#define RIGHT_MARGIN 5
-#define SPACE 5
-#define DELTA 13
-#define MAX_ROUTES 12
+// ask the phone for the next window once scrolling gets this close to the edge
+#define PAGE_MARGIN 3
 
 static Window *s_window;
 static TextLayer *s_time_layer;
@@ -26,31 +30,48 @@ static Layer *s_vehicle_background_layer;
 static Layer *s_vehicle_layer;
 static Layer *s_description_layer;
 static Layer *s_loading_layer;
-static GDrawCommandImage* s_plane_icon;
-static GDrawCommandImage* s_generic_failed_icon;
-static GDrawCommandImage* s_no_internet_icon;
-static GDrawCommandSequence* s_streetcar_sequence;
-static GDrawCommandSequence* s_subway_sequence;
-static GDrawCommandSequence* s_bus_sequence;
-static GDrawCommandSequence* s_regional_train_sequence;
 static GDrawCommandSequence* s_vehicle_sequence;
 static GTextAttributes *s_loading_text_attributes;
 static int s_vehicle_frame_index = 9;
-static AppTimer *s_door_anim_timer;
+static Animation *s_scroll_anim;
+static bool s_scroll_moving = false;
+// how far the running scroll goes, and how far to go once it settles
+static int s_scroll_steps = 0;
+static int s_pending_steps = 0;
+// window offset last asked of the phone, -1 once it has answered
+static int s_requested_offset = -1;
+// a delta couldn't be applied, so the next refresh asks for the whole list again
+static bool s_needs_snapshot = false;
+// showing departures from the last run until the phone sends fresh ones
+static bool s_stale = false;
 
 static char time_text[8];
+static char unit_text[32];
 static char stop_text[32];
 static char dest_text[32];
-static char loading_text[32];
+static char loading_text[40];
+// interned strings currently shown, so entries sharing them skip the re-render
+static const char* s_rendered_stop_name;
+static const char* s_rendered_dest_name;
 
 static WindowDataArray sample_data_arr = {
     .array = NULL,
     .data_len = LOADING,
     .data_index = 0,
     .anim_intermediates = {
-        .color = NULL,
-        .time = NULL,
-    }
+        .has_color = false,
+        .has_time = false,
+    },
+    .seq = 0,
+    .partial = false,
+    .more_coming = false,
+    .window_offset = 0,
+    .total = 0,
+    .num_groups = 0,
+    .capacity = 0,
+    .string_pool = NULL,
+    .string_pool_size = 0,
+    .string_pool_used = 0,
 };
 
 void set_time_text(WindowDataArray* data_arr) {
@@ -58,12 +79,34 @@ void set_time_text(WindowDataArray* data_arr) {
     text_layer_set_text(s_time_layer, time_text);
 }
 
+/*
+The unit, followed by the minutes until the later arrivals if the
+phone sent any, e.g. "min, then 10, 19"
+*/
+static void set_unit_text(WindowData* data) {
+    int16_t next_times[MAX_NEXT_ARRIVALS];
+    const int num_next = window_data_next_times(data, time(NULL), next_times);
+    int len = snprintf(unit_text, sizeof(unit_text), "%s", data->unit);
+    for (int i = 0; i < num_next && len < (int)sizeof(unit_text); i += 1) {
+        len += snprintf(unit_text + len, sizeof(unit_text) - len, i == 0 ? ", then %hd" : ", %hd", next_times[i]);
+    }
+    text_layer_set_text(s_unit_layer, unit_text);
+}
+
 static void set_stop_text(WindowData* data) {
+    if (data->stop_name == s_rendered_stop_name) {
+        return;
+    }
+    s_rendered_stop_name = data->stop_name;
     snprintf(stop_text, sizeof(stop_text), "at %s", data->stop_name);
     text_layer_set_text(s_stop_layer, stop_text);
 }
 
 static void set_dest_text(WindowData* data) {
+    if (data->dest_name == s_rendered_dest_name) {
+        return;
+    }
+    s_rendered_dest_name = data->dest_name;
     if (data->dest_name[0] != 0) {
         snprintf(dest_text, sizeof(dest_text), "%s", data->dest_name);
     } else {
@@ -106,30 +149,30 @@ static void set_error_text(WindowDataArray* data_arr) {
     }
 }
 
+static void set_stale(bool stale) {
+    s_stale = stale;
+    const GColor text_color = stale ? GColorDarkGray : GColorBlack;
+    text_layer_set_text_color(s_time_layer, text_color);
+    text_layer_set_text_color(s_unit_layer, text_color);
+}
+
 static void redraw_all() {
     WindowDataArray* data_arr = window_get_user_data(s_window);
     WindowData* data = window_data_current(data_arr);
     set_time_text(data_arr);
-    text_layer_set_text(s_unit_layer, data->unit);
+    set_unit_text(data);
     set_stop_text(data);
     set_dest_text(data);
 
     if (data_arr->data_len > 0) {
         layer_set_hidden(s_loading_layer, true);
+        resource_cache_release_icons();
     } else {
         layer_set_hidden(s_loading_layer, false);
     }
     set_error_text(data_arr);
 
-    layer_mark_dirty(window_get_root_layer(s_window));
-}
-
-static Animation *create_anim_scroll_out(Layer *layer, uint32_t duration, int16_t dy) {
-    GPoint to_origin = GPoint(0, dy);
-    Animation *result = (Animation *) property_animation_create_bounds_origin(layer, NULL, &to_origin);
-    animation_set_duration(result, duration);
-    animation_set_curve(result, AnimationCurveEaseIn);
-    return result;
+    invalidate_mark(DirtyAll);
 }
 
 static Animation *create_anim_scroll_in(Layer *layer, uint32_t duration, int16_t dy) {
@@ -140,18 +183,13 @@ static Animation *create_anim_scroll_in(Layer *layer, uint32_t duration, int16_t
     return result;
 }
 
-static const uint32_t BACKGROUND_SCROLL_DURATION = 100 * 2;
 static const uint32_t SCROLL_DURATION = 130 * 2;
-static const int16_t SCROLL_DIST_OUT = 40;
 static const int16_t SCROLL_DIST_IN = 16;
 
-static Animation *create_text_outbound_anim(ScrollDirection direction) {
-    const int16_t to_dy = (direction == ScrollDirectionDown) ? -SCROLL_DIST_OUT : SCROLL_DIST_OUT;
-
-    Animation *out_text = create_anim_scroll_out(s_description_layer, SCROLL_DURATION, to_dy);
-    return out_text;
-}
-
+/*
+Nudge the text in from `direction` without changing entries, for when
+there is nothing further to scroll to
+*/
 static Animation *create_text_inbound_anim(ScrollDirection direction) {
     const int16_t from_dy = (direction == ScrollDirectionDown) ? -SCROLL_DIST_IN : SCROLL_DIST_IN;
 
@@ -159,13 +197,8 @@ static Animation *create_text_inbound_anim(ScrollDirection direction) {
     return in_text;
 }
 
-static void anim_during_scroll_inc(Animation *animation, bool finished, void *context) {
-    window_data_inc(&sample_data_arr);
-    redraw_all();
-}
-
-static void anim_during_scroll_dec(Animation *animation, bool finished, void *context) {
-    window_data_dec(&sample_data_arr);
+static void anim_during_scroll(void) {
+    sample_data_arr.data_index += window_data_clamp_steps(&sample_data_arr, s_scroll_steps);
     redraw_all();
 }
 
@@ -173,124 +206,116 @@ static void anim_after_scroll(Animation *animation, bool finished, void *context
     redraw_all();
 }
 
-static void set_door_closed() {
-    s_vehicle_frame_index = 0;
-}
-
-static void open_door_frame_handler(void* context) {
-    if (s_vehicle_frame_index < (int)gdraw_command_sequence_get_num_frames(s_vehicle_sequence) - 1) {
-        s_vehicle_frame_index += 1;
-        layer_mark_dirty(s_vehicle_layer);
-        s_door_anim_timer = app_timer_register(DELTA, open_door_frame_handler, NULL);
-    }
+static uint32_t vehicle_num_frames(WindowData* data) {
+    GDrawCommandSequence* sequence = resource_cache_get_sequence(data->vehicle_type);
+    return sequence ? gdraw_command_sequence_get_num_frames(sequence) : 1;
 }
 
-static void close_door_frame_handler(void* context) {
-    if (s_vehicle_frame_index > 0) {
-        s_vehicle_frame_index -= 1;
-        layer_mark_dirty(s_vehicle_layer);
-        s_door_anim_timer = app_timer_register(DELTA, close_door_frame_handler, NULL);
-    }
+static uint32_t current_vehicle_num_frames(void) {
+    return vehicle_num_frames(window_data_current(&sample_data_arr));
 }
 
-static void _open_door_frame_handler(Animation* animation, bool finished, void* context) {
-    if (s_door_anim_timer == NULL) {
-        app_timer_cancel(s_door_anim_timer);
-    }
-    s_door_anim_timer = app_timer_register(600, open_door_frame_handler, NULL);
-}
+static void start_scroll(int steps);
+static void request_page_if_near_edge(void);
 
-static void make_sure_door_is_closed_handler(Animation* animation, bool finished, void* context) {
-    if (s_door_anim_timer == NULL) {
-        app_timer_cancel(s_door_anim_timer);
+/*
+Presses that arrive while a scroll is still moving are added up here
+and played as one multi-step scroll once it settles
+*/
+static void anim_scroll_settled(Animation *animation, bool finished, void *context) {
+    s_scroll_moving = false;
+    const int steps = window_data_clamp_steps(&sample_data_arr, s_pending_steps);
+    s_pending_steps = 0;
+    if (finished && steps != 0) {
+        start_scroll(steps);
+    } else {
+        request_page_if_near_edge();
     }
-    s_door_anim_timer = NULL;
-    set_door_closed();
 }
 
-static Animation *create_scroll_anim(ScrollDirection direction) {
-    ScrollDirection opposite_direction = (direction == ScrollDirectionDown) ? ScrollDirectionUp : ScrollDirectionDown;
-    Animation* out_anim = create_text_outbound_anim(direction);
-    animation_set_handlers(out_anim, (AnimationHandlers) {
-        .stopped = (direction == ScrollDirectionDown) ? anim_during_scroll_inc : anim_during_scroll_dec,
-    }, NULL);
-    app_timer_register(0, close_door_frame_handler, NULL);
-    Animation* in_anim = create_text_inbound_anim(opposite_direction);
-    animation_set_handlers(in_anim, (AnimationHandlers) {
-        .stopped = _open_door_frame_handler,
+/*
+Scroll `steps` entries at once (negative meaning up) with one transition,
+then open the door once the new vehicle has pulled in
+*/
+static Animation *create_scroll_anim(int steps) {
+    s_scroll_steps = steps;
+    Animation* scroll_anim = create_anim_scroll(&sample_data_arr, s_description_layer, s_vehicle_layer,
+        &s_vehicle_frame_index, steps, anim_during_scroll);
+    animation_set_handlers(scroll_anim, (AnimationHandlers) {
+        .stopped = anim_scroll_settled,
     }, NULL);
-    Animation* vehicle_out_anim = create_vehicle_outbound_anim(direction, s_vehicle_layer, make_sure_door_is_closed_handler);
-    Animation* vehicle_in_anim = create_vehicle_inbound_anim(opposite_direction, s_vehicle_layer);
-    Animation* vehicle_sequence = animation_sequence_create(vehicle_out_anim, vehicle_in_anim, NULL);
-    animation_set_delay(vehicle_sequence, 260);
-    GColor* next_color = (direction == ScrollDirectionDown)
-        ? &(window_data_next(&sample_data_arr)->color)
-        : &(window_data_prev(&sample_data_arr)->color);
-    Animation* colour_anim = create_anim_bg_colour(s_window, next_color);
-    int16_t* next_time = (direction == ScrollDirectionDown)
-        ? &(window_data_next(&sample_data_arr)->time)
-        : &(window_data_prev(&sample_data_arr)->time);
-    Animation* number_anim = create_anim_number(s_window, next_time);
-    animation_set_delay(number_anim, 100);
-    Animation* sequence = animation_spawn_create(
-        animation_sequence_create(out_anim, in_anim, NULL),
-        vehicle_sequence,
-        colour_anim,
-        number_anim,
-        NULL);
+    // the door opens on the vehicle the scroll lands on
+    Animation* door_open_anim = create_anim_door_open(&s_vehicle_frame_index, current_vehicle_num_frames,
+        vehicle_num_frames(window_data_offset(&sample_data_arr, steps)));
+    animation_set_delay(door_open_anim, 460);
+    Animation* sequence = animation_sequence_create(scroll_anim, door_open_anim, NULL);
     animation_set_handlers(sequence, (AnimationHandlers) {
         .stopped = anim_after_scroll,
     }, NULL);
     return sequence;
 }
 
+/*
+Jump to the first departure at the next stop in one scroll, wrapping
+back to the first stop after the last. Ignored mid-scroll, since
+where that scroll ends up isn't known yet.
+*/
 static void select_click_handler(ClickRecognizerRef recognizer, void *context) {
-    //text_layer_set_text(s_time_layer, "Select");
+    if (s_scroll_moving) {
+        return;
+    }
+    const int steps = window_data_next_group_steps(&sample_data_arr);
+    if (steps != 0) {
+        start_scroll(steps);
+    } else {
+        animation_schedule(create_text_inbound_anim(ScrollDirectionDown));
+    }
 }
 
-static void up_click_handler(ClickRecognizerRef recognizer, void *context) {
-    int res = window_data_can_dec(&sample_data_arr);
-    if (res == 0) {
-        animation_schedule(create_scroll_anim(ScrollDirectionUp));
-    }
-    else {
-        animation_schedule(create_text_inbound_anim(ScrollDirectionUp));
+static void start_scroll(int steps) {
+    // the previous scroll may still be waiting to open the door
+    if (s_scroll_anim != NULL && animation_is_scheduled(s_scroll_anim)) {
+        animation_unschedule(s_scroll_anim);
     }
+    s_scroll_moving = true;
+    s_scroll_anim = create_scroll_anim(steps);
+    animation_schedule(s_scroll_anim);
 }
 
-static void down_click_handler(ClickRecognizerRef recognizer, void *context) {
-    int res = window_data_can_inc(&sample_data_arr);
-    if (res == 0) {
-        animation_schedule(create_scroll_anim(ScrollDirectionDown));
+static void scroll_click(int step) {
+    if (s_scroll_moving) {
+        s_pending_steps += step;
+        return;
+    }
+    if (window_data_clamp_steps(&sample_data_arr, step) != 0) {
+        start_scroll(step);
     }
     else {
-        animation_schedule(create_text_inbound_anim(ScrollDirectionDown));
+        animation_schedule(create_text_inbound_anim(step > 0 ? ScrollDirectionDown : ScrollDirectionUp));
+        request_page_if_near_edge();
     }
 }
 
+static void up_click_handler(ClickRecognizerRef recognizer, void *context) {
+    scroll_click(-1);
+}
+
+static void down_click_handler(ClickRecognizerRef recognizer, void *context) {
+    scroll_click(1);
+}
+
 static void click_config_provider(void *context) {
     window_single_click_subscribe(BUTTON_ID_SELECT, select_click_handler);
     window_single_click_subscribe(BUTTON_ID_UP, up_click_handler);
     window_single_click_subscribe(BUTTON_ID_DOWN, down_click_handler);
 }
 
-static GDrawCommandSequence* vehicle_type_to_sequence(VehicleType vehicle_type) {
-    switch (vehicle_type) {
-    case STREETCAR:
-        return s_streetcar_sequence;
-    case SUBWAY:
-        return s_subway_sequence;
-    case BUS:
-        return s_bus_sequence;
-    case REGIONAL_TRAIN:
-        return s_regional_train_sequence;
-    }
-    return s_bus_sequence;
-}
-
 static void vehicle_update_proc(Layer *layer, GContext *ctx) {
     WindowData* data = window_data_current(window_get_user_data(s_window));
-    s_vehicle_sequence = vehicle_type_to_sequence(data->vehicle_type);
+    s_vehicle_sequence = resource_cache_get_sequence(data->vehicle_type);
+    if (s_vehicle_sequence == NULL) {
+        return;
+    }
 
     GRect bounds = layer_get_bounds(layer);
     GPoint vehicle_origin = GPoint(bounds.origin.x, bounds.origin.y + 40);
@@ -320,46 +345,51 @@ static void vehicle_background_update_proc(Layer *layer, GContext *ctx) {
     }
 }
 
-static void route_layer_update_proc(Layer *layer, GContext *ctx) {
-    WindowData* data = window_data_current(window_get_user_data(s_window));
-
-    GRect bounds = layer_get_bounds(layer);
+static void measure_route_layout(WindowData* data, GRect bounds) {
     GSize number_text_size = graphics_text_layout_get_content_size(
         data->route_number, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD), bounds, GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft);
-    uint16_t pill_width = data->shape == CIRCLE ? bounds.size.h : number_text_size.w + 10;
+    uint16_t pill_width = route_layout_pill_width(bounds, data->shape, number_text_size);
     GSize name_text_size = graphics_text_layout_get_content_size(
-        data->route_name, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD), 
-        GRect(bounds.origin.x + pill_width + SPACE, bounds.origin.y, bounds.size.w - pill_width - SPACE - RIGHT_MARGIN, bounds.size.h),
+        data->route_name, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD),
+        route_layout_name_box(bounds, pill_width),
         GTextOverflowModeTrailingEllipsis, GTextAlignmentRight);
-    GRect name_bounds = GRect(
-        bounds.origin.x + bounds.size.w - name_text_size.w - RIGHT_MARGIN,
-        bounds.origin.y,
-        name_text_size.w,
-        bounds.size.h);
-    GRect pill_bounds = GRect(
-        name_bounds.origin.x - pill_width - SPACE,
-        bounds.origin.y,
-        pill_width,
-        bounds.size.h);
-    GRect number_text_bounds = GRect(
-        pill_bounds.origin.x + (pill_width - number_text_size.w) / 2,
-        bounds.origin.y,
-        number_text_size.w,
-        bounds.size.h);
+    data->route_layout = route_layout_arrange(bounds, pill_width, number_text_size, name_text_size);
+    data->route_layout_valid = true;
+}
+
+/*
+Measure every departure that doesn't have a layout yet, so scrolling
+between them never has to measure text
+*/
+static void measure_route_layouts(WindowDataArray* data_arr) {
+    GRect bounds = layer_get_bounds(s_route_layer);
+    for (int i = 0; i < data_arr->data_len; i += 1) {
+        if (!data_arr->array[i].route_layout_valid) {
+            measure_route_layout(&data_arr->array[i], bounds);
+        }
+    }
+}
+
+static void route_layer_update_proc(Layer *layer, GContext *ctx) {
+    WindowData* data = window_data_current(window_get_user_data(s_window));
+    if (!data->route_layout_valid) {
+        measure_route_layout(data, layer_get_bounds(layer));
+    }
+    const RouteLayout* layout = &data->route_layout;
 
     graphics_context_set_fill_color(ctx, data->color);
     if (data->shape == ROUNDRECT) {
-        graphics_fill_rect(ctx, pill_bounds, 10, GCornersAll);
+        graphics_fill_rect(ctx, layout->pill_bounds, 10, GCornersAll);
     } else if (data->shape == RECT) {
-        graphics_fill_rect(ctx, pill_bounds, 0, GCornerNone);
+        graphics_fill_rect(ctx, layout->pill_bounds, 0, GCornerNone);
     } else if (data->shape == CIRCLE) {
-        graphics_fill_rect(ctx, pill_bounds, 30, GCornersAll);
+        graphics_fill_rect(ctx, layout->pill_bounds, 30, GCornersAll);
     }
     graphics_context_set_text_color(ctx, GColorWhite);
-    graphics_draw_text(ctx, data->route_number, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD), number_text_bounds, GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, 0);
+    graphics_draw_text(ctx, data->route_number, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD), layout->number_bounds, GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, 0);
 
     graphics_context_set_text_color(ctx, GColorBlack);
-    graphics_draw_text(ctx, data->route_name, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD), name_bounds, GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, 0);
+    graphics_draw_text(ctx, data->route_name, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD), layout->name_bounds, GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, 0);
 }
 
 static void description_layer_update_proc(Layer *layer, GContext *ctx) {
@@ -380,21 +410,25 @@ static void loading_layer_update_proc(Layer *layer, GContext *ctx) {
         bounds.size.w, bounds.size.h - icon_padding - icon_height - icon_padding);
 
 
+    GDrawCommandImage* icon = NULL;
     if (data_arr->data_len == 0) {
         // icon for loading
         graphics_context_set_fill_color(ctx, GColorPictonBlue);
         graphics_fill_rect(ctx, bounds, 0, GCornerNone);
-        gdraw_command_image_draw(ctx, s_plane_icon, icon_origin);
+        icon = resource_cache_get_icon(IconPlane);
     } else if (data_arr->data_len < 0) {
         // icon for error
         graphics_context_set_fill_color(ctx, GColorMelon);
         graphics_fill_rect(ctx, bounds, 0, GCornerNone);
         if (data_arr->data_len == NO_CONNECTION) {
-            gdraw_command_image_draw(ctx, s_no_internet_icon, icon_origin);
+            icon = resource_cache_get_icon(IconNoInternet);
         } else {
-            gdraw_command_image_draw(ctx, s_generic_failed_icon, icon_origin);
+            icon = resource_cache_get_icon(IconGenericFailed);
         }
     }
+    if (icon) {
+        gdraw_command_image_draw(ctx, icon, icon_origin);
+    }
 
     graphics_context_set_text_color(ctx, GColorBlack);
     graphics_draw_text(ctx, loading_text, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD), text_bounds,
@@ -409,9 +443,11 @@ static void create_time_layer(GRect bounds, WindowDataArray* data_arr) {
 }
 
 static void create_unit_layer(GRect bounds, WindowData* data) {
-    s_unit_layer = text_layer_create(GRect(0, 44, bounds.size.w - RIGHT_BAR_WIDTH - RIGHT_MARGIN, 120));
-    text_layer_set_text(s_unit_layer, data->unit);
+    // one line, so a long list of later arrivals can't run into the description
+    s_unit_layer = text_layer_create(GRect(0, 44, bounds.size.w - RIGHT_BAR_WIDTH - RIGHT_MARGIN, 20));
+    set_unit_text(data);
     text_layer_set_text_alignment(s_unit_layer, GTextAlignmentRight);
+    text_layer_set_overflow_mode(s_unit_layer, GTextOverflowModeTrailingEllipsis);
 }
 
 static void create_stop_layer(GRect bounds, WindowData* data) {
@@ -496,9 +532,24 @@ static void window_load(Window *window) {
     create_loading_layer(bounds);
     layer_add_child(window_layer, s_loading_layer);
     layer_mark_dirty(s_loading_layer);
+
+    invalidate_register(text_layer_get_layer(s_time_layer), DirtyTime);
+    invalidate_register(text_layer_get_layer(s_unit_layer), DirtyDeparture | DirtyTime);
+    invalidate_register(text_layer_get_layer(s_stop_layer), DirtyDeparture);
+    invalidate_register(text_layer_get_layer(s_dest_layer), DirtyDeparture);
+    invalidate_register(s_route_layer, DirtyDeparture);
+    invalidate_register(s_vehicle_background_layer, DirtyColor | DirtyDeparture);
+    invalidate_register(s_vehicle_layer, DirtyVehicleFrame | DirtyDeparture);
+    invalidate_register(s_loading_layer, DirtyStatus);
+
+    if (s_stale) {
+        set_stale(true);
+        redraw_all();
+    }
 }
 
 static void window_unload(Window *window) {
+    invalidate_unregister_all();
     text_layer_destroy(s_time_layer);
     text_layer_destroy(s_unit_layer);
     text_layer_destroy(s_stop_layer);
@@ -507,108 +558,214 @@ static void window_unload(Window *window) {
     layer_destroy(s_vehicle_layer);
     layer_destroy(s_description_layer);
     layer_destroy(s_loading_layer);
-    gdraw_command_image_destroy(s_plane_icon);
-    gdraw_command_image_destroy(s_generic_failed_icon);
-    gdraw_command_image_destroy(s_no_internet_icon);
-    gdraw_command_sequence_destroy(s_streetcar_sequence);
-    gdraw_command_sequence_destroy(s_subway_sequence);
-    gdraw_command_sequence_destroy(s_bus_sequence);
-    gdraw_command_sequence_destroy(s_regional_train_sequence);
+    resource_cache_deinit();
     graphics_text_attributes_destroy(s_loading_text_attributes);
     layer_destroy(s_route_layer);
 }
 
-static void send_refresh(void* context) {
+/*
+Count the shown minutes down locally, animating the current departure's
+time if it changed. Mid-scroll the scroll animation picks up the new
+time when it settles. The later arrivals keep counting down even when
+the first one is stuck at 0, so they're updated every minute.
+*/
+static void minute_tick_handler(struct tm* tick_time, TimeUnits units_changed) {
+    if (sample_data_arr.data_len <= 0) {
+        return;
+    }
+    const int16_t shown_time = window_data_current(&sample_data_arr)->time;
+    const bool changed = window_data_update_times(&sample_data_arr, time(NULL));
+    WindowData* current = window_data_current(&sample_data_arr);
+    if (current->num_next > 0) {
+        set_unit_text(current);
+        invalidate_mark(DirtyTime);
+    }
+    if (!changed) {
+        return;
+    }
+    if (current->time == shown_time || s_scroll_moving || sample_data_arr.anim_intermediates.has_time) {
+        return;
+    }
+    sample_data_arr.anim_intermediates.time = shown_time;
+    sample_data_arr.anim_intermediates.has_time = true;
+    animation_schedule(create_anim_number(s_window, &current->time));
+}
+
+static void send_refresh(void) {
     DictionaryIterator *iter;
-    app_message_outbox_begin(&iter);
+    if (app_message_outbox_begin(&iter) != APP_MSG_OK) {
+        // a page request may still be going out, back off and try again
+        refresh_failed();
+        return;
+    }
+    // tell the phone what we have so it can send just the changes
+    dict_write_int32(iter, MESSAGE_KEY_seq, sample_data_arr.seq);
+    if (s_needs_snapshot) {
+        // the phone can answer this from the list it last sent, without fetching
+        dict_write_int32(iter, MESSAGE_KEY_needs_snapshot, 1);
+    }
 
-    app_message_outbox_send();
+    if (app_message_outbox_send() != APP_MSG_OK) {
+        refresh_failed();
+    }
+}
+
+/*
+The watch only holds a window of the phone's departures; once the
+current one is within PAGE_MARGIN of an end that isn't the end of the
+whole list, ask for a window centred on it instead. The reply is a
+delta, so the current departure stays selected.
+*/
+static void request_page_if_near_edge(void) {
+    WindowDataArray* data_arr = &sample_data_arr;
+    if (data_arr->data_len <= 0) {
+        return;
+    }
+    const bool more_before = data_arr->window_offset > 0;
+    const bool more_after = data_arr->window_offset + data_arr->data_len < data_arr->total;
+    const bool near_start = data_arr->data_index < PAGE_MARGIN;
+    const bool near_end = data_arr->data_index >= data_arr->data_len - PAGE_MARGIN;
+    if (!(near_start && more_before) && !(near_end && more_after)) {
+        return;
+    }
+
+    int offset = data_arr->window_offset + data_arr->data_index - WINDOW_SIZE / 2;
+    if (offset > data_arr->total - WINDOW_SIZE) {
+        offset = data_arr->total - WINDOW_SIZE;
+    }
+    if (offset < 0) {
+        offset = 0;
+    }
+    if (offset == data_arr->window_offset || offset == s_requested_offset) {
+        return;
+    }
+
+    DictionaryIterator *iter;
+    if (app_message_outbox_begin(&iter) != APP_MSG_OK) {
+        // something else is being sent, the next scroll will try again
+        return;
+    }
+    dict_write_int32(iter, MESSAGE_KEY_seq, data_arr->seq);
+    dict_write_int32(iter, MESSAGE_KEY_page_offset, offset);
+    if (app_message_outbox_send() == APP_MSG_OK) {
+        s_requested_offset = offset;
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Asked for departures from %d of %d", offset, data_arr->total);
+    }
+}
+
+static void schedule_refresh(void) {
+    if (sample_data_arr.more_coming) {
+        refresh_expect_more();
+    } else if (sample_data_arr.data_len > 0) {
+        refresh_succeeded(&sample_data_arr);
+    } else {
+        refresh_failed();
+    }
 }
 
 static void inbox_received_callback(DictionaryIterator *iter, void *context) {
+    Tuple* departures = dict_find(iter, MESSAGE_KEY_departures);
     Tuple* num_routes = dict_find(iter, MESSAGE_KEY_num_routes);
-    if (num_routes) {
-        sample_data_arr.data_len = num_routes->value->int16;
-        if (sample_data_arr.data_len > 0) {
-            for (int i = 0; i < sample_data_arr.data_len; i += 1) {
-                Tuple* time = dict_find(iter, MESSAGE_KEY_time + i);
-                Tuple* unit = dict_find(iter, MESSAGE_KEY_unit + i);
-                Tuple* stop_name = dict_find(iter, MESSAGE_KEY_stop_name + i);
-                Tuple* dest_name = dict_find(iter, MESSAGE_KEY_dest_name + i);
-                Tuple* route_number = dict_find(iter, MESSAGE_KEY_route_number + i);
-                Tuple* route_name = dict_find(iter, MESSAGE_KEY_route_name + i);
-                Tuple* vehicle_type = dict_find(iter, MESSAGE_KEY_vehicle_type + i);
-                Tuple* color = dict_find(iter, MESSAGE_KEY_color + i);
-                Tuple* shape = dict_find(iter, MESSAGE_KEY_shape + i);
-
-                if (time == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing time at index %d", i);
-                if (unit == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing unit at index %d", i);
-                if (stop_name == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing stop_name at index %d", i);
-                if (dest_name == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing dest_name at index %d", i);
-                if (route_number == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing route_number at index %d", i);
-                if (route_name == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing route_name at index %d", i);
-                if (vehicle_type == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing vehicle_type at index %d", i);
-                if (color == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing color at index %d", i);
-                if (shape == NULL) APP_LOG(APP_LOG_LEVEL_DEBUG, "Message from PKJS missing shape at index %d", i);
-                if (time == NULL || unit == NULL || stop_name == NULL || dest_name == NULL || route_number == NULL
-                    || route_name == NULL || vehicle_type == NULL || color == NULL || shape == NULL) {
-                    sample_data_arr.data_len = COULD_NOT_DECODE_MESSAGE;
-                    break;
-                }
-
-                sample_data_arr.array[i].time = time->value->int16;
-                strncpy(sample_data_arr.array[i].unit, unit->value->cstring, 32);
-                strncpy(sample_data_arr.array[i].stop_name, stop_name->value->cstring, 32);
-                strncpy(sample_data_arr.array[i].dest_name, dest_name->value->cstring, 32);
-                strncpy(sample_data_arr.array[i].route_number, route_number->value->cstring, 32);
-                strncpy(sample_data_arr.array[i].route_name, route_name->value->cstring, 32);
-                sample_data_arr.array[i].vehicle_type = (VehicleType)vehicle_type->value->int16;
-                sample_data_arr.array[i].color = (GColor){.argb=color->value->int16};
-                sample_data_arr.array[i].shape = (RouteShape)shape->value->int16;
-            }
+
+    // keep the same departure selected if it's still there
+    int current_id = sample_data_arr.data_len > 0 ? window_data_current(&sample_data_arr)->id : -1;
+    MessageType type = MessageTypeSnapshot;
+    bool page_reply = false;
+    if (departures) {
+        DecodeResult result = message_decode_departures(
+            &sample_data_arr, departures->value->data, departures->length, &type);
+        page_reply = result == DecodeResultUpdated && s_requested_offset != -1
+            && sample_data_arr.window_offset == s_requested_offset;
+        if (result == DecodeResultNeedsSnapshot) {
+            sample_data_arr.seq = 0;
+            s_needs_snapshot = true;
+            refresh_now();
+            return;
         }
+        s_needs_snapshot = false;
+        if (result == DecodeResultInvalid) {
+            window_data_array_reset(&sample_data_arr);
+            sample_data_arr.data_len = COULD_NOT_DECODE_MESSAGE;
+        } else if (result == DecodeResultUnchanged) {
+            schedule_refresh();
+            return;
+        }
+    } else if (num_routes) {
+        // errors are sent on their own as a negative route count
+        s_needs_snapshot = false;
+        window_data_array_reset(&sample_data_arr);
+        sample_data_arr.data_len = num_routes->value->int16;
+    } else {
+        return;
+    }
+    set_stale(false);
+    s_requested_offset = -1;
+    // the pool may have been reset and reused, so old pointers mean nothing
+    s_rendered_stop_name = NULL;
+    s_rendered_dest_name = NULL;
+    measure_route_layouts(&sample_data_arr);
+    window_data_update_times(&sample_data_arr, time(NULL));
+
+    int index = current_id != -1 ? window_data_find(&sample_data_arr, current_id) : -1;
+    if (index != -1) {
+        sample_data_arr.data_index = index;
+    } else if (sample_data_arr.data_index >= sample_data_arr.data_len) {
+        sample_data_arr.data_index = 0;
+    }
+
+    if (type == MessageTypeSnapshot) {
         // set the vehicle frame to the most open state (i.e. at the end of the sequence)
-        s_vehicle_frame_index = (int)gdraw_command_sequence_get_num_frames(
-            vehicle_type_to_sequence(sample_data_arr.array[0].vehicle_type)
-        ) - 1;
-        redraw_all();
+        s_vehicle_frame_index = (int)current_vehicle_num_frames() - 1;
+    }
+    redraw_all();
 
-        // vibrate to let the user know something was updated
+    if (type == MessageTypeSnapshot) {
+        // vibrate to let the user know something was updated; departures
+        // streamed in after the first screen come as deltas, so this only
+        // happens once
         vibes_short_pulse();
+    }
 
-        app_timer_register(60000, send_refresh, NULL);
+    // a page the watch scrolled to isn't a refresh, so the next one stays when it was
+    if (!page_reply || refresh_awaiting_reply()) {
+        schedule_refresh();
     }
 }
 
-static void init(void) {
-    sample_data_arr.array = malloc(MAX_ROUTES*sizeof(WindowData));
-    for (int i = 0; i < MAX_ROUTES; i += 1) {
-        sample_data_arr.array[i] = (WindowData) {
-            .time = 10,
-            .unit = malloc(32*sizeof(char)),
-            .stop_name = malloc(32*sizeof(char)),
-            .dest_name = malloc(32*sizeof(char)),
-            .route_number = malloc(32*sizeof(char)),
-            .route_name = malloc(32*sizeof(char)),
-            .vehicle_type = STREETCAR,
-            .color = GColorRed,
-            .shape = ROUNDRECT,
-        };
+static void outbox_failed_callback(DictionaryIterator *iter, AppMessageResult reason, void *context) {
+    if (dict_find(iter, MESSAGE_KEY_page_offset) != NULL) {
+        // the next scroll near the edge asks again, refreshes carry on as they were
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Page request failed to send: %d", (int)reason);
+        s_requested_offset = -1;
+        return;
     }
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Refresh request failed to send: %d", (int)reason);
+    refresh_failed();
+}
+
+/*
+Returns false, having set nothing up, if there isn't enough memory for
+the departures; the app can't show anything without them
+*/
+static bool init(void) {
+    const size_t heap_used_before = heap_bytes_used();
+    if (!window_data_array_init(&sample_data_arr, WINDOW_SIZE, STRING_POOL_BYTES)) {
+        APP_LOG(APP_LOG_LEVEL_ERROR, "Not enough memory for %d departures", WINDOW_SIZE);
+        return false;
+    }
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Departure storage uses %d bytes of heap (%d routes)",
+        (int)(heap_bytes_used() - heap_used_before), WINDOW_SIZE);
     sample_data_arr.data_index = 0;
+    if (departure_store_load(&sample_data_arr)) {
+        s_stale = true;
+        window_data_update_times(&sample_data_arr, time(NULL));
+    }
 
     set_error_text(&sample_data_arr);
 
-    s_plane_icon = gdraw_command_image_create_with_resource(RESOURCE_ID_PLANE);
-    s_generic_failed_icon = gdraw_command_image_create_with_resource(RESOURCE_ID_GENERIC_FAILED);
-    s_no_internet_icon = gdraw_command_image_create_with_resource(RESOURCE_ID_NO_INTERNET);
-    s_streetcar_sequence = gdraw_command_sequence_create_with_resource(RESOURCE_ID_STREETCAR_ANIM);
-    s_subway_sequence = gdraw_command_sequence_create_with_resource(RESOURCE_ID_SUBWAY_ANIM);
-    s_bus_sequence = gdraw_command_sequence_create_with_resource(RESOURCE_ID_BUS_ANIM);
-    s_regional_train_sequence = gdraw_command_sequence_create_with_resource(RESOURCE_ID_TRAIN_ANIM);
-
     app_message_register_inbox_received(inbox_received_callback);
-    const int inbox_size = 2048;
+    app_message_register_outbox_failed(outbox_failed_callback);
+    const int inbox_size = app_message_inbox_size_maximum();
     const int outbox_size = 32;
     app_message_open(inbox_size, outbox_size);
 
@@ -621,22 +778,26 @@ static void init(void) {
     });
     const bool animated = true;
     window_stack_push(s_window, animated);
+
+    tick_timer_service_subscribe(MINUTE_UNIT, minute_tick_handler);
+    refresh_init(send_refresh);
+    return true;
 }
 
 static void deinit(void) {
-    window_destroy(s_window);
-    for (int i = 0; i < MAX_ROUTES; i += 1) {
-        free(sample_data_arr.array[i].unit);
-        free(sample_data_arr.array[i].stop_name);
-        free(sample_data_arr.array[i].dest_name);
-        free(sample_data_arr.array[i].route_number);
-        free(sample_data_arr.array[i].route_name);
+    tick_timer_service_unsubscribe();
+    refresh_deinit();
+    if (!s_stale && sample_data_arr.data_len > 0) {
+        departure_store_save(&sample_data_arr);
     }
-    free(sample_data_arr.array);
+    window_destroy(s_window);
+    window_data_array_deinit(&sample_data_arr);
 }
 
 int main(void) {
-    init();
+    if (!init()) {
+        return 1;
+    }
 
     APP_LOG(APP_LOG_LEVEL_DEBUG, "Done initializing, pushed window: %p", s_window);
 
@@ -0,0 +1,471 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <pebble.h>
+#include "message.h"
+#include "data.h"
+
+typedef struct {
+    const uint8_t* pos;
+    const uint8_t* end;
+} Reader;
+
+static bool read_u8(Reader* reader, uint8_t* out) {
+    if (reader->end - reader->pos < 1) {
+        return false;
+    }
+    *out = *reader->pos;
+    reader->pos += 1;
+    return true;
+}
+
+static bool read_u16(Reader* reader, uint16_t* out) {
+    if (reader->end - reader->pos < 2) {
+        return false;
+    }
+    *out = (uint16_t)(reader->pos[0] | (reader->pos[1] << 8));
+    reader->pos += 2;
+    return true;
+}
+
+static bool read_u32(Reader* reader, uint32_t* out) {
+    if (reader->end - reader->pos < 4) {
+        return false;
+    }
+    *out = (uint32_t)reader->pos[0] | ((uint32_t)reader->pos[1] << 8)
+        | ((uint32_t)reader->pos[2] << 16) | ((uint32_t)reader->pos[3] << 24);
+    reader->pos += 4;
+    return true;
+}
+
+/*
+Read an arrival time and the gaps to the later arrivals after it
+*/
+static bool read_arrivals(Reader* reader, uint32_t* arrival, uint8_t* next_gaps, uint8_t* num_next) {
+    if (!read_u32(reader, arrival) || !read_u8(reader, num_next) || *num_next > MAX_NEXT_ARRIVALS) {
+        return false;
+    }
+    for (int i = 0; i < *num_next; i += 1) {
+        if (!read_u8(reader, &next_gaps[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Read a string table of `count` strings, interning each one into the
+pool. `strings` must have room for `count` pointers.
+*/
+static bool read_strings(Reader* reader, WindowDataArray* array, char** strings, int count) {
+    for (int i = 0; i < count; i += 1) {
+        uint8_t len;
+        if (!read_u8(reader, &len) || len > MAX_STRING_BYTES || reader->end - reader->pos < len) {
+            return false;
+        }
+        strings[i] = window_data_intern_string(array, (const char*)reader->pos, len);
+        reader->pos += len;
+    }
+    return true;
+}
+
+/*
+Check a string table without storing anything, adding the pool space
+it could need to `string_bytes`
+*/
+static bool skip_strings(Reader* reader, int count, size_t* string_bytes) {
+    for (int i = 0; i < count; i += 1) {
+        uint8_t len;
+        if (!read_u8(reader, &len) || len > MAX_STRING_BYTES || reader->end - reader->pos < len) {
+            return false;
+        }
+        reader->pos += len;
+        *string_bytes += len + 1;
+    }
+    return true;
+}
+
+static bool read_string_index(Reader* reader, char** strings, int num_strings, char** out) {
+    uint8_t index;
+    if (!read_u8(reader, &index) || index >= num_strings) {
+        return false;
+    }
+    if (strings != NULL) {
+        *out = strings[index];
+    }
+    return true;
+}
+
+/*
+Read a record into `data`. With `strings` NULL the string indices are
+only checked, which is used to validate deltas before applying them.
+*/
+static bool read_record(Reader* reader, WindowData* data, char** strings, int num_strings) {
+    uint8_t vehicle_type, color, shape;
+    if (!read_u16(reader, &data->id)
+        || !read_arrivals(reader, &data->arrival, data->next_gaps, &data->num_next)
+        || !read_u8(reader, &vehicle_type)
+        || !read_u8(reader, &color)
+        || !read_u8(reader, &shape)) {
+        return false;
+    }
+    if (vehicle_type > REGIONAL_TRAIN || shape > CIRCLE) {
+        return false;
+    }
+    data->vehicle_type = (VehicleType)vehicle_type;
+    data->color = (GColor){.argb=color};
+    data->shape = (RouteShape)shape;
+    data->route_layout_valid = false;
+
+    return read_string_index(reader, strings, num_strings, &data->unit)
+        && read_string_index(reader, strings, num_strings, &data->stop_name)
+        && read_string_index(reader, strings, num_strings, &data->dest_name)
+        && read_string_index(reader, strings, num_strings, &data->route_number)
+        && read_string_index(reader, strings, num_strings, &data->route_name);
+}
+
+static int find_id(const uint16_t* ids, int count, uint16_t id) {
+    for (int i = 0; i < count; i += 1) {
+        if (ids[i] == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static DecodeResult decode_snapshot(Reader* reader, WindowDataArray* array, uint16_t seq) {
+    window_data_array_reset(array);
+
+    uint8_t num_strings;
+    if (!read_u8(reader, &num_strings) || num_strings > NUM_RECORD_STRINGS * array->capacity) {
+        return DecodeResultInvalid;
+    }
+    // a full pool would leave entries blank, so check everything fits first
+    const Reader strings_start = *reader;
+    size_t string_bytes = 0;
+    if (!skip_strings(reader, num_strings, &string_bytes)) {
+        return DecodeResultInvalid;
+    }
+    if (string_bytes > window_data_string_pool_free(array)) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Departures need %d bytes of strings, only room for %d",
+            (int)string_bytes, (int)window_data_string_pool_free(array));
+        return DecodeResultInvalid;
+    }
+    *reader = strings_start;
+    char* strings[num_strings > 0 ? num_strings : 1];
+    uint8_t count;
+    if (!read_strings(reader, array, strings, num_strings) || !read_u8(reader, &count)) {
+        window_data_array_reset(array);
+        return DecodeResultInvalid;
+    }
+    if (count > array->capacity) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Departures message has %d routes, only room for %d", count, array->capacity);
+        window_data_array_reset(array);
+        return DecodeResultInvalid;
+    }
+
+    // deltas and navigation find departures by id, so each must be unique
+    uint16_t ids[count > 0 ? count : 1];
+    for (int i = 0; i < count; i += 1) {
+        if (!read_record(reader, &array->array[i], strings, num_strings)) {
+            APP_LOG(APP_LOG_LEVEL_DEBUG, "Departures message truncated or invalid at index %d", i);
+            window_data_array_reset(array);
+            return DecodeResultInvalid;
+        }
+        ids[i] = array->array[i].id;
+        if (find_id(ids, i, ids[i]) != -1) {
+            APP_LOG(APP_LOG_LEVEL_DEBUG, "Departures message repeats id %d at index %d", ids[i], i);
+            window_data_array_reset(array);
+            return DecodeResultInvalid;
+        }
+    }
+    if (reader->pos != reader->end) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Departures message has %d trailing bytes", (int)(reader->end - reader->pos));
+        window_data_array_reset(array);
+        return DecodeResultInvalid;
+    }
+    array->data_len = count;
+    array->seq = seq;
+    return DecodeResultUpdated;
+}
+
+static void swap_entries(WindowDataArray* array, int a, int b) {
+    WindowData tmp = array->array[a];
+    array->array[a] = array->array[b];
+    array->array[b] = tmp;
+}
+
+/*
+Deltas are checked completely before anything is touched, so a bad one
+leaves the current departures intact and we can keep showing them while
+a snapshot is requested
+*/
+static DecodeResult decode_delta(Reader* reader, WindowDataArray* array, uint16_t seq) {
+    uint16_t base_seq;
+    uint8_t count;
+    if (!read_u16(reader, &base_seq) || !read_u8(reader, &count)) {
+        return DecodeResultInvalid;
+    }
+    if (array->seq == 0 || base_seq != array->seq || array->data_len <= 0) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Delta based on seq %d but we have seq %d", base_seq, array->seq);
+        return DecodeResultNeedsSnapshot;
+    }
+    if (count == 0 || count > array->capacity) {
+        return DecodeResultInvalid;
+    }
+
+    uint16_t ids[count];
+    uint32_t arrivals[count];
+    uint8_t next_gaps[count][MAX_NEXT_ARRIVALS];
+    uint8_t num_next[count];
+    for (int i = 0; i < count; i += 1) {
+        if (!read_u16(reader, &ids[i])
+            || !read_arrivals(reader, &arrivals[i], next_gaps[i], &num_next[i])
+            || find_id(ids, i, ids[i]) != -1) {
+            return DecodeResultInvalid;
+        }
+    }
+
+    // validation pass over the strings and records
+    const Reader strings_start = *reader;
+    uint8_t num_strings;
+    size_t string_bytes = 0;
+    if (!read_u8(reader, &num_strings)
+        || num_strings > NUM_RECORD_STRINGS * count
+        || !skip_strings(reader, num_strings, &string_bytes)) {
+        return DecodeResultInvalid;
+    }
+    uint8_t num_records;
+    if (!read_u8(reader, &num_records) || num_records > count) {
+        return DecodeResultInvalid;
+    }
+    uint16_t record_ids[count];
+    for (int i = 0; i < num_records; i += 1) {
+        WindowData record;
+        if (!read_record(reader, &record, NULL, num_strings)) {
+            return DecodeResultInvalid;
+        }
+        record_ids[i] = record.id;
+        if (find_id(ids, count, record_ids[i]) == -1
+            || find_id(record_ids, i, record_ids[i]) != -1) {
+            return DecodeResultInvalid;
+        }
+    }
+    if (reader->pos != reader->end) {
+        return DecodeResultInvalid;
+    }
+    for (int i = 0; i < count; i += 1) {
+        if (window_data_find(array, ids[i]) == -1 && find_id(record_ids, num_records, ids[i]) == -1) {
+            APP_LOG(APP_LOG_LEVEL_DEBUG, "Delta refers to unknown departure %d", ids[i]);
+            return DecodeResultNeedsSnapshot;
+        }
+    }
+    if (string_bytes > window_data_string_pool_free(array)) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "String pool too full for delta");
+        return DecodeResultNeedsSnapshot;
+    }
+
+    bool changed = num_records > 0 || count != array->data_len;
+
+    // drop departures that aren't listed any more
+    int kept = 0;
+    for (int i = 0; i < array->data_len; i += 1) {
+        if (find_id(ids, count, array->array[i].id) != -1) {
+            array->array[kept] = array->array[i];
+            kept += 1;
+        }
+    }
+    array->data_len = kept;
+
+    // records replace the departure with the same id or are appended
+    *reader = strings_start;
+    reader->pos += 1;
+    char* strings[num_strings > 0 ? num_strings : 1];
+    read_strings(reader, array, strings, num_strings);
+    reader->pos += 1;
+    for (int i = 0; i < num_records; i += 1) {
+        int index = window_data_find(array, record_ids[i]);
+        if (index == -1) {
+            index = array->data_len;
+            array->data_len += 1;
+        }
+        read_record(reader, &array->array[index], strings, num_strings);
+    }
+
+    // put everything in the listed order and update the arrival times
+    for (int i = 0; i < count; i += 1) {
+        int index = window_data_find(array, ids[i]);
+        if (index != i) {
+            swap_entries(array, i, index);
+            changed = true;
+        }
+        WindowData* data = &array->array[i];
+        if (data->arrival != arrivals[i]
+            || data->num_next != num_next[i]
+            || memcmp(data->next_gaps, next_gaps[i], num_next[i]) != 0) {
+            data->arrival = arrivals[i];
+            data->num_next = num_next[i];
+            memcpy(data->next_gaps, next_gaps[i], num_next[i]);
+            changed = true;
+        }
+    }
+    array->seq = seq;
+    return changed ? DecodeResultUpdated : DecodeResultUnchanged;
+}
+
+/*
+Decode a departures message into the array's storage. Snapshots are
+decoded in a single pass; if one turns out to be truncated, to have
+trailing bytes or to contain values out of range the array is left
+empty and DecodeResultInvalid is returned.
+*/
+DecodeResult message_decode_departures(WindowDataArray* array, const uint8_t* buffer, size_t length, MessageType* type) {
+    Reader reader = {
+        .pos = buffer,
+        .end = buffer + length,
+    };
+
+    uint8_t version, message_type, flags;
+    uint16_t seq, window_offset, total;
+    if (!read_u8(&reader, &version) || !read_u8(&reader, &message_type) || !read_u16(&reader, &seq)
+        || !read_u8(&reader, &flags) || !read_u16(&reader, &window_offset) || !read_u16(&reader, &total)) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Departures message too short");
+        return DecodeResultInvalid;
+    }
+    if (version != MESSAGE_FORMAT_VERSION) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Departures message has version %d, expected %d", version, MESSAGE_FORMAT_VERSION);
+        return DecodeResultInvalid;
+    }
+
+    *type = (MessageType)message_type;
+    DecodeResult result = DecodeResultInvalid;
+    switch (message_type) {
+    case MessageTypeSnapshot:
+        result = decode_snapshot(&reader, array, seq);
+        break;
+    case MessageTypeDelta:
+        result = decode_delta(&reader, array, seq);
+        break;
+    }
+    if (result == DecodeResultUpdated) {
+        window_data_index_groups(array);
+    }
+    if (result == DecodeResultUpdated || result == DecodeResultUnchanged) {
+        array->partial = (flags & MessageFlagPartial) != 0;
+        array->more_coming = (flags & MessageFlagMore) != 0;
+        array->window_offset = window_offset;
+        array->total = total;
+    }
+    return result;
+}
+
+typedef struct {
+    uint8_t* pos;
+    uint8_t* end;
+} Writer;
+
+static bool write_u8(Writer* writer, uint8_t value) {
+    if (writer->end - writer->pos < 1) {
+        return false;
+    }
+    *writer->pos = value;
+    writer->pos += 1;
+    return true;
+}
+
+static bool write_u16(Writer* writer, uint16_t value) {
+    return write_u8(writer, value & 0xff) && write_u8(writer, value >> 8);
+}
+
+static bool write_u32(Writer* writer, uint32_t value) {
+    return write_u16(writer, value & 0xffff) && write_u16(writer, value >> 16);
+}
+
+static bool write_arrivals(Writer* writer, WindowData* data) {
+    bool ok = write_u32(writer, data->arrival) && write_u8(writer, data->num_next);
+    for (int i = 0; ok && i < data->num_next; i += 1) {
+        ok = write_u8(writer, data->next_gaps[i]);
+    }
+    return ok;
+}
+
+/*
+Strings are interned, so equal strings are found by pointer. Adds the
+string to `strings` if it isn't there yet and returns its index.
+*/
+static int string_index(const char** strings, int* num_strings, const char* str) {
+    for (int i = 0; i < *num_strings; i += 1) {
+        if (strings[i] == str) {
+            return i;
+        }
+    }
+    strings[*num_strings] = str;
+    *num_strings += 1;
+    return *num_strings - 1;
+}
+
+static const char** record_strings(WindowData* data, const char** out) {
+    out[0] = data->unit;
+    out[1] = data->stop_name;
+    out[2] = data->dest_name;
+    out[3] = data->route_number;
+    out[4] = data->route_name;
+    return out;
+}
+
+/*
+Encode the departures as a snapshot message in the same format the
+phone sends, so it can be decoded with message_decode_departures.
+Returns the length, or 0 if it doesn't fit in `size` bytes.
+*/
+size_t message_encode_snapshot(WindowDataArray* array, uint8_t* buffer, size_t size) {
+    if (array->data_len <= 0) {
+        return 0;
+    }
+    Writer writer = {
+        .pos = buffer,
+        .end = buffer + size,
+    };
+    const char* strings[NUM_RECORD_STRINGS * array->data_len];
+    int num_strings = 0;
+    const char* fields[NUM_RECORD_STRINGS];
+    for (int i = 0; i < array->data_len; i += 1) {
+        record_strings(&array->array[i], fields);
+        for (int j = 0; j < NUM_RECORD_STRINGS; j += 1) {
+            string_index(strings, &num_strings, fields[j]);
+        }
+    }
+
+    bool ok = write_u8(&writer, MESSAGE_FORMAT_VERSION)
+        && write_u8(&writer, MessageTypeSnapshot)
+        && write_u16(&writer, array->seq)
+        && write_u8(&writer, array->partial ? MessageFlagPartial : 0)
+        && write_u16(&writer, array->window_offset)
+        && write_u16(&writer, array->total)
+        && write_u8(&writer, num_strings);
+    for (int i = 0; ok && i < num_strings; i += 1) {
+        const size_t len = strlen(strings[i]);
+        ok = len <= UINT8_MAX && (size_t)(writer.end - writer.pos) > len && write_u8(&writer, len);
+        if (ok) {
+            memcpy(writer.pos, strings[i], len);
+            writer.pos += len;
+        }
+    }
+    ok = ok && write_u8(&writer, array->data_len);
+    for (int i = 0; ok && i < array->data_len; i += 1) {
+        WindowData* data = &array->array[i];
+        ok = write_u16(&writer, data->id)
+            && write_arrivals(&writer, data)
+            && write_u8(&writer, data->vehicle_type)
+            && write_u8(&writer, data->color.argb)
+            && write_u8(&writer, data->shape);
+        record_strings(data, fields);
+        for (int j = 0; ok && j < NUM_RECORD_STRINGS; j += 1) {
+            ok = write_u8(&writer, string_index(strings, &num_strings, fields[j]));
+        }
+    }
+    return ok ? (size_t)(writer.pos - buffer) : 0;
+}
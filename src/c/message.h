@@ -0,0 +1,90 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+#include "data.h"
+
+/*
+Departures arrive from the phone as one byte array (see
+src/pkjs/message.js for the encoder). Integers are little endian.
+
+    u8 version, u8 type, u16 seq, u8 flags (MessageFlag),
+    u16 window offset, u16 total, then
+
+    snapshot: strings, u8 count, `count` records
+    delta:    u16 base_seq, u8 count, `count` x (u16 id, arrivals),
+              strings, u8 record count, records
+
+    strings:  u8 count, then `count` length-prefixed strings (u8 length, bytes),
+              each at most MAX_STRING_BYTES long
+    arrivals: u32 arrival, u8 count, `count` x u8 minutes after the
+              previous arrival (at most MAX_NEXT_ARRIVALS)
+    record:   u16 id, arrivals, u8 vehicle_type, u8 color, u8 shape,
+              and u8 indices into the strings for
+              unit, stop_name, dest_name, route_number, route_name
+
+Each distinct string is sent once per message, and it is interned in the
+WindowDataArray string pool so entries that share a string share the
+pointer too. `arrival` is in seconds since the epoch; the minutes shown
+are worked out on the watch (see window_data_update_times).
+
+A delta lists every departure in its new order; records are only sent
+for departures the watch doesn't have yet or whose fields changed, and
+anything not listed is removed. A delta only applies on top of the
+departures with sequence number `base_seq`.
+
+The phone keeps the full list of departures; the watch only holds a
+window of up to WINDOW_SIZE of them, starting at `offset` in a list of
+`total`, and asks for another window (MESSAGE_KEY_page_offset) when
+scrolling gets near either end. Changing windows is just another delta.
+
+On launch the phone streams departures in as stops answer: a snapshot
+with just the soonest departure, then deltas flagged MessageFlagMore
+until the last one.
+*/
+#define MESSAGE_FORMAT_VERSION 7
+// departures held on the watch at once, WINDOW_SIZE in src/pkjs/message.js
+#define WINDOW_SIZE 12
+// longest string the phone sends, MAX_STRING_BYTES in src/pkjs/message.js
+#define MAX_STRING_BYTES 31
+// unit, stop_name, dest_name, route_number and route_name
+#define NUM_RECORD_STRINGS 5
+/*
+String pool for a window, STRING_POOL_BYTES in src/pkjs/message.js.
+It is sized for how much departures usually share, not for every string
+being different (1920 bytes). A window with a stop name for every two
+departures, its own destination for each, and route strings shared in
+pairs needs about 820 bytes at the full 31 bytes a string; typical names
+need a quarter of that. The rest is room for page deltas to add strings.
+A delta that doesn't fit asks for a snapshot, and the phone cuts a
+snapshot short rather than send more than fits.
+*/
+#define STRING_POOL_BYTES 1024
+
+typedef enum {
+    MessageTypeSnapshot = 0,
+    MessageTypeDelta = 1,
+} MessageType;
+
+typedef enum {
+    // some stops didn't answer in time, so departures for them may be old or missing
+    MessageFlagPartial = 1 << 0,
+    // the phone is still fetching, more departures follow in another message
+    MessageFlagMore = 1 << 1,
+} MessageFlag;
+
+typedef enum {
+    DecodeResultUpdated,
+    DecodeResultUnchanged,
+    // the message can't be applied to what we have, ask for a snapshot
+    DecodeResultNeedsSnapshot,
+    DecodeResultInvalid,
+} DecodeResult;
+
+DecodeResult message_decode_departures(WindowDataArray*, const uint8_t* buffer, size_t length, MessageType* type);
+size_t message_encode_snapshot(WindowDataArray*, uint8_t* buffer, size_t size);
@@ -0,0 +1,161 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <pebble.h>
+#include "refresh.h"
+#include "data.h"
+
+// how long the phone gets to answer before it counts as a failure,
+// fetching every stop can take a while
+#define REPLY_TIMEOUT_MS (60 * 1000)
+#define MIN_INTERVAL_MS (30 * 1000)
+#define MAX_INTERVAL_MS (5 * 60 * 1000)
+#define BACKOFF_BASE_MS (15 * 1000)
+#define MAX_BACKOFF_MS (10 * 60 * 1000)
+#define LOW_BATTERY_PERCENT 20
+#define CRITICAL_BATTERY_PERCENT 10
+
+static RefreshSender s_send;
+static AppTimer* s_timer = NULL;
+static bool s_awaiting_reply = false;
+static int s_failures = 0;
+
+static void refresh_timer_fired(void* context);
+
+static uint32_t battery_adjusted(uint32_t interval_ms) {
+    const BatteryChargeState battery = battery_state_service_peek();
+    if (battery.is_charging || battery.is_plugged) {
+        return interval_ms;
+    } else if (battery.charge_percent <= CRITICAL_BATTERY_PERCENT) {
+        return interval_ms * 4;
+    } else if (battery.charge_percent <= LOW_BATTERY_PERCENT) {
+        return interval_ms * 2;
+    }
+    return interval_ms;
+}
+
+static void arm(uint32_t interval_ms, const char* reason) {
+    if (s_timer != NULL) {
+        app_timer_cancel(s_timer);
+        s_timer = NULL;
+    }
+    if (!connection_service_peek_pebble_app_connection()) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Phone disconnected, refreshing when it's back");
+        return;
+    }
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Next refresh in %d s (%s)", (int)(interval_ms / 1000), reason);
+    s_timer = app_timer_register(interval_ms, refresh_timer_fired, NULL);
+}
+
+/*
+A third of the time until the nearest departure, so a bus 3 minutes
+away is checked every minute and one 15 minutes away every 5
+*/
+static uint32_t interval_for(WindowDataArray* array) {
+    if (array->data_len <= 0) {
+        return MAX_INTERVAL_MS;
+    }
+    int16_t nearest = array->array[0].time;
+    for (int i = 1; i < array->data_len; i += 1) {
+        if (array->array[i].time < nearest) {
+            nearest = array->array[i].time;
+        }
+    }
+    uint32_t interval_ms = (uint32_t)nearest * SECONDS_PER_MINUTE * 1000 / 3;
+    if (interval_ms < MIN_INTERVAL_MS) {
+        return MIN_INTERVAL_MS;
+    } else if (interval_ms > MAX_INTERVAL_MS) {
+        return MAX_INTERVAL_MS;
+    }
+    return interval_ms;
+}
+
+// exponential backoff with up to 25% jitter either way, so retries spread out
+static uint32_t backoff_for(int failures) {
+    uint32_t backoff_ms = BACKOFF_BASE_MS;
+    for (int i = 1; i < failures && backoff_ms < MAX_BACKOFF_MS; i += 1) {
+        backoff_ms *= 2;
+    }
+    if (backoff_ms > MAX_BACKOFF_MS) {
+        backoff_ms = MAX_BACKOFF_MS;
+    }
+    const int32_t jitter = (int32_t)(backoff_ms / 4);
+    return backoff_ms + (rand() % (2 * jitter + 1)) - jitter;
+}
+
+static void refresh_timer_fired(void* context) {
+    s_timer = NULL;
+    if (s_awaiting_reply) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "No reply from the phone");
+        refresh_failed();
+    } else {
+        refresh_now();
+    }
+}
+
+static void pebble_app_connection_handler(bool connected) {
+    if (connected) {
+        refresh_now();
+    } else if (s_timer != NULL) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Phone disconnected, refreshing when it's back");
+        app_timer_cancel(s_timer);
+        s_timer = NULL;
+    }
+}
+
+void refresh_now(void) {
+    s_awaiting_reply = true;
+    arm(REPLY_TIMEOUT_MS, "waiting for reply");
+    if (s_timer != NULL) {
+        s_send();
+    }
+}
+
+void refresh_succeeded(WindowDataArray* array) {
+    s_awaiting_reply = false;
+    s_failures = 0;
+    if (array->partial) {
+        // try the stops that didn't answer again soon
+        arm(battery_adjusted(MIN_INTERVAL_MS), "partial result");
+    } else {
+        arm(battery_adjusted(interval_for(array)), "nearest departure");
+    }
+}
+
+void refresh_expect_more(void) {
+    s_awaiting_reply = true;
+    arm(REPLY_TIMEOUT_MS, "more departures coming");
+}
+
+void refresh_failed(void) {
+    s_awaiting_reply = false;
+    s_failures += 1;
+    arm(battery_adjusted(backoff_for(s_failures)), "backoff");
+}
+
+bool refresh_awaiting_reply(void) {
+    return s_awaiting_reply;
+}
+
+void refresh_init(RefreshSender send) {
+    s_send = send;
+    s_failures = 0;
+    srand(time(NULL));
+    connection_service_subscribe((ConnectionHandlers) {
+        .pebble_app_connection_handler = pebble_app_connection_handler,
+    });
+    // the phone sends departures by itself when it starts, so just wait for them
+    s_awaiting_reply = true;
+    arm(REPLY_TIMEOUT_MS, "waiting for first departures");
+}
+
+void refresh_deinit(void) {
+    connection_service_unsubscribe();
+    if (s_timer != NULL) {
+        app_timer_cancel(s_timer);
+        s_timer = NULL;
+    }
+}
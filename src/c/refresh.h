@@ -0,0 +1,32 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+#include "data.h"
+
+typedef void (*RefreshSender)(void);
+
+/*
+Decides when to next ask the phone for departures. There is never more
+than one refresh pending: every call below replaces it.
+
+The interval follows the nearest departure, since predictions move most
+just before a vehicle arrives. Failures back off exponentially with
+jitter, nothing is scheduled while the phone is disconnected, and
+intervals are stretched when the battery is low.
+*/
+void refresh_init(RefreshSender send);
+void refresh_deinit(void);
+// ask now, e.g. when the watch needs a snapshot
+void refresh_now(void);
+void refresh_succeeded(WindowDataArray*);
+// the phone is streaming departures in, keep waiting for the rest
+void refresh_expect_more(void);
+void refresh_failed(void);
+// whether a refresh (or the rest of one) is still to come from the phone
+bool refresh_awaiting_reply(void);
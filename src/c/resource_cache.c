@@ -0,0 +1,114 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <pebble.h>
+#include "resource_cache.h"
+#include "data.h"
+
+#define NUM_VEHICLE_TYPES 4
+#define NUM_ICONS 3
+// the current departure's and the ones either side of it, so scrolling back and forth doesn't reload
+#define MAX_CACHED_SEQUENCES 3
+// below this much free heap, drop everything that isn't being asked for before loading
+#define LOW_HEAP_BYTES 4096
+
+static const uint32_t s_sequence_resources[NUM_VEHICLE_TYPES] = {
+    [STREETCAR] = RESOURCE_ID_STREETCAR_ANIM,
+    [SUBWAY] = RESOURCE_ID_SUBWAY_ANIM,
+    [BUS] = RESOURCE_ID_BUS_ANIM,
+    [REGIONAL_TRAIN] = RESOURCE_ID_TRAIN_ANIM,
+};
+
+static const uint32_t s_icon_resources[NUM_ICONS] = {
+    [IconPlane] = RESOURCE_ID_PLANE,
+    [IconGenericFailed] = RESOURCE_ID_GENERIC_FAILED,
+    [IconNoInternet] = RESOURCE_ID_NO_INTERNET,
+};
+
+static GDrawCommandSequence* s_sequences[NUM_VEHICLE_TYPES];
+// when each sequence was last asked for, to pick which to evict
+static uint32_t s_sequence_last_used[NUM_VEHICLE_TYPES];
+static uint32_t s_use_counter = 0;
+static GDrawCommandImage* s_icons[NUM_ICONS];
+
+static void evict_sequence(int index) {
+    gdraw_command_sequence_destroy(s_sequences[index]);
+    s_sequences[index] = NULL;
+}
+
+static int num_cached_sequences(void) {
+    int count = 0;
+    for (int i = 0; i < NUM_VEHICLE_TYPES; i += 1) {
+        if (s_sequences[i] != NULL) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+static void evict_least_recently_used_sequence(void) {
+    int oldest = -1;
+    for (int i = 0; i < NUM_VEHICLE_TYPES; i += 1) {
+        if (s_sequences[i] != NULL && (oldest == -1 || s_sequence_last_used[i] < s_sequence_last_used[oldest])) {
+            oldest = i;
+        }
+    }
+    if (oldest != -1) {
+        evict_sequence(oldest);
+    }
+}
+
+static void evict_all_sequences_except(int keep) {
+    for (int i = 0; i < NUM_VEHICLE_TYPES; i += 1) {
+        if (i != keep && s_sequences[i] != NULL) {
+            evict_sequence(i);
+        }
+    }
+}
+
+GDrawCommandSequence* resource_cache_get_sequence(VehicleType vehicle_type) {
+    int index = (vehicle_type >= 0 && vehicle_type < NUM_VEHICLE_TYPES) ? (int)vehicle_type : (int)BUS;
+    s_use_counter += 1;
+    s_sequence_last_used[index] = s_use_counter;
+    if (s_sequences[index] != NULL) {
+        return s_sequences[index];
+    }
+
+    if (heap_bytes_free() < LOW_HEAP_BYTES) {
+        APP_LOG(APP_LOG_LEVEL_DEBUG, "Heap low (%d bytes free), dropping cached resources", (int)heap_bytes_free());
+        evict_all_sequences_except(index);
+        resource_cache_release_icons();
+    } else if (num_cached_sequences() >= MAX_CACHED_SEQUENCES) {
+        evict_least_recently_used_sequence();
+    }
+    s_sequences[index] = gdraw_command_sequence_create_with_resource(s_sequence_resources[index]);
+    return s_sequences[index];
+}
+
+GDrawCommandImage* resource_cache_get_icon(Icon icon) {
+    if (s_icons[icon] == NULL) {
+        s_icons[icon] = gdraw_command_image_create_with_resource(s_icon_resources[icon]);
+    }
+    return s_icons[icon];
+}
+
+/*
+The icons are only shown while loading or on errors, so they can go as
+soon as there are departures to show
+*/
+void resource_cache_release_icons(void) {
+    for (int i = 0; i < NUM_ICONS; i += 1) {
+        if (s_icons[i] != NULL) {
+            gdraw_command_image_destroy(s_icons[i]);
+            s_icons[i] = NULL;
+        }
+    }
+}
+
+void resource_cache_deinit(void) {
+    evict_all_sequences_except(-1);
+    resource_cache_release_icons();
+}
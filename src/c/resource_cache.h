@@ -0,0 +1,27 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+#include "data.h"
+
+typedef enum {
+    IconPlane,
+    IconGenericFailed,
+    IconNoInternet,
+} Icon;
+
+/*
+Vehicle sequences and icons are loaded the first time they're needed.
+Up to three sequences are kept at once, and everything but the one
+being asked for is dropped if the heap runs low. Either getter can
+return NULL if there isn't enough memory to load the resource.
+*/
+GDrawCommandSequence* resource_cache_get_sequence(VehicleType);
+GDrawCommandImage* resource_cache_get_icon(Icon);
+void resource_cache_release_icons(void);
+void resource_cache_deinit(void);
@@ -0,0 +1,45 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#include <pebble.h>
+#include "route_layout.h"
+#include "data.h"
+
+uint16_t route_layout_pill_width(GRect bounds, RouteShape shape, GSize number_text_size) {
+    return shape == CIRCLE ? bounds.size.h : number_text_size.w + 10;
+}
+
+/*
+The space the route name is allowed to take up, to the right of the pill
+*/
+GRect route_layout_name_box(GRect bounds, uint16_t pill_width) {
+    return GRect(bounds.origin.x + pill_width + SPACE, bounds.origin.y,
+        bounds.size.w - pill_width - SPACE - RIGHT_MARGIN, bounds.size.h);
+}
+
+/*
+The name is right-aligned against the margin and the pill sits just to
+its left, with the number centred inside the pill
+*/
+RouteLayout route_layout_arrange(GRect bounds, uint16_t pill_width, GSize number_text_size, GSize name_text_size) {
+    RouteLayout layout;
+    layout.name_bounds = GRect(
+        bounds.origin.x + bounds.size.w - name_text_size.w - RIGHT_MARGIN,
+        bounds.origin.y,
+        name_text_size.w,
+        bounds.size.h);
+    layout.pill_bounds = GRect(
+        layout.name_bounds.origin.x - pill_width - SPACE,
+        bounds.origin.y,
+        pill_width,
+        bounds.size.h);
+    layout.number_bounds = GRect(
+        layout.pill_bounds.origin.x + (pill_width - number_text_size.w) / 2,
+        bounds.origin.y,
+        number_text_size.w,
+        bounds.size.h);
+    return layout;
+}
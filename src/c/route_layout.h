@@ -0,0 +1,21 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+#include "data.h"
+
+#define RIGHT_MARGIN 5
+#define SPACE 5
+
+/*
+The layout is only arithmetic on text sizes that have already been
+measured, so none of this needs a graphics context
+*/
+uint16_t route_layout_pill_width(GRect bounds, RouteShape shape, GSize number_text_size);
+GRect route_layout_name_box(GRect bounds, uint16_t pill_width);
+RouteLayout route_layout_arrange(GRect bounds, uint16_t pill_width, GSize number_text_size, GSize name_text_size);
@@ -0,0 +1,20 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+const EARTH_RADIUS_M = 6371000;
+
+function to_radians(degrees) {
+    return degrees * Math.PI / 180;
+}
+
+// great-circle distance in metres (haversine)
+exports.distance_m = function(lat1, lon1, lat2, lon2) {
+    const d_lat = to_radians(lat2 - lat1);
+    const d_lon = to_radians(lon2 - lon1);
+    const a = Math.pow(Math.sin(d_lat / 2), 2)
+        + Math.cos(to_radians(lat1)) * Math.cos(to_radians(lat2)) * Math.pow(Math.sin(d_lon / 2), 2);
+    return 2 * EARTH_RADIUS_M * Math.asin(Math.min(1, Math.sqrt(a)));
+}
@@ -7,10 +7,41 @@ file, You can obtain one at https://mozilla.org/MPL/2.0/.
 const apikey = require('./apikey');
 const keys = require('message_keys');
 const corrections = require('./operator_corrections');
+const stop_cache = require('./stop_cache');
+const stop_index = require('./stop_index');
+const { rank_departures } = require('./ranking');
+const { distance_m } = require('./geo');
+const { encode_snapshot, encode_delta, fit_string_pool, departure_id, WINDOW_SIZE, MAX_NEXT_ARRIVALS } = require('./message');
 const { VehicleType, RouteShape, GColor, ErrorCode } = require("./data");
 
-const MAX_WATCH_DATA = 12;
 const SEARCH_RADIUS_M = 500;
+const NUM_STOPS = 9;
+// the most departures kept for the watch to page through
+const MAX_RANKED_DEPARTURES = 48;
+const TRANSSEE_URL = "http://transsee.ca/publicJSONFeed";
+// keep request URLs within what every HTTP stack along the way accepts
+const MAX_URL_LENGTH = 2000;
+// a slow stop shouldn't hold up the rest: each request gets REQUEST_TIMEOUT_MS
+// and is retried while there's time, and whatever has arrived by
+// FETCH_DEADLINE_MS is sent as it is
+const REQUEST_TIMEOUT_MS = 5000;
+const MAX_ATTEMPTS = 2;
+const FETCH_DEADLINE_MS = 8000;
+// how often to download stops.txt again for the offline stop index
+const STOP_INDEX_MAX_AGE_MS = 7 * 24 * 60 * 60 * 1000;
+
+// the last departures the watch acknowledged, so refreshes can be sent as deltas
+let last_sent = null;
+let next_seq = 1;
+// the watch only holds WINDOW_SIZE departures at a time, starting at
+// window_offset in the full list, and asks for other pages as it scrolls
+let current_result = null;
+let window_offset = 0;
+// only one message is in flight at a time (sending_seq is its seq); if
+// more are sent meanwhile only the latest is kept, since it's worked out
+// against last_sent when it goes
+let sending_seq = null;
+let queued_send = null;
 
 function rgb_to_pebble_colour(hexstr) {
     // adapted from https://github.com/pebble-examples/cards-example/blob/master/tools/pebble_image_routines.py
@@ -29,52 +60,54 @@ function rgb_to_pebble_colour(hexstr) {
     return argb8;
 }
 
-function transsee_dep_to_watch_data(stop, route, direction, prediction) {
+/*
+Arrival as seconds since the epoch; the watch counts down to it by itself.
+Predictions come with epochTime in ms, but fall back to the minutes if not.
+*/
+function prediction_arrival(prediction) {
+    if (prediction.hasOwnProperty("epochTime")) {
+        return Math.floor(parseInt(prediction.epochTime) / 1000);
+    }
+    return Math.floor(Date.now() / 1000) + parseInt(prediction.minutes) * 60;
+}
+
+// `predictions` are soonest first; the ones after the first become next_arrivals
+function transsee_dep_to_watch_data(stop, route, direction, predictions) {
+    const prediction = predictions[0];
     let watch_data = {};
-    watch_data[keys.time] = parseInt(prediction.minutes);
-    watch_data[keys.unit] = "min";
-    watch_data[keys.stop_name] = stop.stop_name;
-    watch_data[keys.dest_name] = direction;
-    watch_data[keys.route_number] = route.routeTag;
-    watch_data[keys.route_name] = route.routeTitle.replace(watch_data[keys.route_number] + "-", "");
-    watch_data[keys.vehicle_type] = VehicleType.BUS;
+    watch_data.id = departure_id([stop.agency, stop.stop_id, route.routeTag, direction].join("|"));
+    // not sent, used to keep a stop's departures when it doesn't answer
+    watch_data.stop_key = stop_key(stop);
+    watch_data.arrival = prediction_arrival(prediction);
+    watch_data.next_arrivals = predictions.slice(1, 1 + MAX_NEXT_ARRIVALS).map(prediction_arrival);
+    watch_data.unit = "min";
+    watch_data.stop_name = stop.stop_name;
+    watch_data.dest_name = direction;
+    watch_data.route_number = route.routeTag;
+    watch_data.route_name = route.routeTitle.replace(watch_data.route_number + "-", "");
+    watch_data.vehicle_type = VehicleType.BUS;
     if (route.hasOwnProperty("color")) {
-        watch_data[keys.color] = rgb_to_pebble_colour(route.color);
+        watch_data.color = rgb_to_pebble_colour(route.color);
     } else {
-        watch_data[keys.color] = GColor.GColorBlackARGB8;
+        watch_data.color = GColor.GColorBlackARGB8;
     }
-    watch_data[keys.shape] = RouteShape.ROUNDRECT;
+    watch_data.shape = RouteShape.ROUNDRECT;
 
-    if (corrections.transsee.hasOwnProperty(route.agencyTitle)) {
-        corrections.transsee[route.agencyTitle](stop, route, direction, prediction, watch_data);
-    }
+    corrections.apply_transsee(stop, route, direction, prediction, watch_data);
 
     return watch_data;
 }
 
-function compare_distance_to_here_stops(lat, lon) {
-    return function(stop1, stop2) {
-        const stop1_lat = stop1.stop_lat;
-        const stop1_lon = stop1.stop_lon;
-        const stop2_lat = stop2.stop_lat;
-        const stop2_lon = stop2.stop_lon;
-        const dist1 = Math.sqrt(
-            Math.pow(stop1_lat - lat, 2) + Math.pow(stop1_lon - lon, 2)
-        );
-        const dist2 = Math.sqrt(
-            Math.pow(stop2_lat - lat, 2) + Math.pow(stop2_lon - lon, 2)
-        );
-        if (dist1 > dist2) {
-            return 1;
-        } else if (dist1 < dist2) {
-            return -1;
-        } else {
-            return 0;
-        }
-    }
+// distances are worked out once per stop rather than in every comparison
+function sort_by_distance(stops, lat, lon) {
+    return stops.map((stop) => [distance_m(lat, lon, stop.stop_lat, stop.stop_lon), stop])
+        .sort((a, b) => a[0] - b[0])
+        .map(([distance, stop]) => stop);
 }
 
 function send_error(error) {
+    last_sent = null;
+    current_result = null;
     Pebble.sendAppMessage({"num_routes": error}, function() {
         console.log('Error message sent successfully');
     }, function(e) {
@@ -82,33 +115,100 @@ function send_error(error) {
     });
 }
 
-function send_to_watch(departures_for_watch) {
-    let combined_watch_data = {};
-    for (const [index, watch_data] of departures_for_watch.entries()) {
-        if (index == MAX_WATCH_DATA) {
-            break;
+// hash collisions are rare, but ids have to be unique within one message
+function make_ids_unique(departures) {
+    let seen = new Set();
+    for (const watch_data of departures) {
+        while (seen.has(watch_data.id)) {
+            watch_data.id = (watch_data.id + 1) & 0xffff || 1;
         }
-        combined_watch_data[keys.time + index] = watch_data[keys.time];
-        combined_watch_data[keys.unit + index] = watch_data[keys.unit];
-        combined_watch_data[keys.stop_name + index] = watch_data[keys.stop_name];
-        combined_watch_data[keys.dest_name + index] = watch_data[keys.dest_name];
-        combined_watch_data[keys.route_number + index] = watch_data[keys.route_number];
-        combined_watch_data[keys.route_name + index] = watch_data[keys.route_name];
-        combined_watch_data[keys.vehicle_type + index] = watch_data[keys.vehicle_type];
-        combined_watch_data[keys.color + index] = watch_data[keys.color];
-        combined_watch_data[keys.shape + index] = watch_data[keys.shape];
-        combined_watch_data[keys.num_routes] = index + 1;
+        seen.add(watch_data.id);
     }
+}
 
-    if (departures_for_watch.length == 0) {
+function take_seq() {
+    const seq = next_seq;
+    next_seq = (next_seq + 1) & 0xffff || 1;
+    return seq;
+}
+
+/*
+`result` is what get_departures_for_watch_with_stops resolves to; it
+replaces the list the watch pages through. `watch_seq` is the sequence
+number of the departures the watch currently has (0 if none), or null for
+whatever we last sent it.
+*/
+function send_to_watch(result, watch_seq) {
+    if (result.departures.length == 0) {
         send_error(ErrorCode.NO_RESULTS);
         return;
     }
+    make_ids_unique(result.departures);
+    current_result = result;
+    send_window(watch_seq);
+}
 
+/*
+Send the page of the current list starting at window_offset. If
+`watch_seq` matches what we last sent, only the differences are sent;
+otherwise the watch has missed something and gets a snapshot.
+*/
+function send_window(watch_seq) {
+    if (sending_seq !== null) {
+        // worked out when it goes, so the latest list and window are used; a
+        // watch that's up to date will have the message in flight by then
+        const up_to_date = watch_seq === null || watch_seq == sending_seq
+            || (last_sent !== null && watch_seq == last_sent.seq);
+        queued_send = { "watch_seq": up_to_date ? null : watch_seq };
+        return;
+    }
+    const result = current_result;
+    if (result === null) {
+        // an error replaced the list while this was queued
+        return;
+    }
+    const total = result.departures.length;
+    window_offset = Math.max(0, Math.min(window_offset, total - WINDOW_SIZE));
+    let departures = result.departures.slice(window_offset, window_offset + WINDOW_SIZE);
+    const seq = take_seq();
+    const header = {
+        "partial": result.partial,
+        "more": result.more === true,
+        "offset": window_offset,
+        "total": total,
+    };
+    let combined_watch_data = {};
+    if (last_sent !== null && (watch_seq === null || watch_seq == last_sent.seq)) {
+        combined_watch_data[keys.departures] = encode_delta(last_sent.seq, seq, last_sent.departures, departures, header);
+    } else {
+        // a delta that overflows the pool gets a snapshot asked for, which has to fit
+        departures = fit_string_pool(departures);
+        combined_watch_data[keys.departures] = encode_snapshot(seq, departures, header);
+    }
+
+    const send_queued = function() {
+        sending_seq = null;
+        if (queued_send !== null) {
+            const next = queued_send;
+            queued_send = null;
+            send_window(next.watch_seq);
+        }
+    };
+    sending_seq = seq;
     Pebble.sendAppMessage(combined_watch_data, function() {
-        console.log('Message sent successfully: ' + JSON.stringify(combined_watch_data));
+        console.log('Message sent successfully: ' + combined_watch_data[keys.departures].length
+            + ' bytes, departures ' + window_offset + '-' + (window_offset + departures.length) + ' of ' + total
+            + ', seq ' + seq + (result.partial ? ' (partial)' : '') + (header.more ? ' (more coming)' : ''));
+        last_sent = {
+            "seq": seq,
+            "departures": departures,
+        };
+        send_queued();
     }, function(e) {
         console.log('Message failed: ' + JSON.stringify(e));
+        // the watch shows the error and asks again, so anything queued is moot
+        sending_seq = null;
+        queued_send = null;
         send_error(ErrorCode.COULD_NOT_SEND_MESSAGE);
     });
 }
@@ -131,63 +231,212 @@ async function get_stops(lat, lon, radius) {
         throw e;
     });
 
-    return json.toSorted(compare_distance_to_here_stops(lat, lon)).slice(0, 9);
+    return sort_by_distance(json, lat, lon).slice(0, NUM_STOPS);
 }
 
-async function get_departures_transsee(stop) {
-    if (!apikey.hasOwnProperty("TRANSSEE_USERID")) {
-        throw new Error("TRANSSEE_USERID is not set");
-    }
+function fetch_error(message, error_code) {
+    let e = new Error(message);
+    e.error_code = error_code;
+    return e;
+}
 
-    let departures_url = new URL("http://transsee.ca/publicJSONFeed");
-    if (corrections.stop_tag.hasOwnProperty(stop.agency)) {
-        const stop_params = corrections.stop_tag[stop.agency](stop);
-        let params = new URLSearchParams({
-            "command": "predictionsForMultiStops",
-            "premium": apikey.TRANSSEE_USERID,
-            "a": stop.agency,
+function with_timeout(promise, timeout_ms) {
+    return new Promise((resolve, reject) => {
+        const timer = setTimeout(() => reject(fetch_error("Timed out", ErrorCode.NO_CONNECTION)), timeout_ms);
+        promise.then((value) => {
+            clearTimeout(timer);
+            resolve(value);
+        }, (e) => {
+            clearTimeout(timer);
+            reject(e);
         });
-        for (stop_param of stop_params) {
-            params.append("stops", stop_param);
-        }
-        departures_url.search = params;
-    } else {
-        departures_url.search = new URLSearchParams({
-            "command": "predictions",
-            "premium": apikey.TRANSSEE_USERID,
-            "a": stop.agency,
-            "stopId": stop.stop_code,
-        });
-    }
+    });
+}
+
+async function fetch_transsee_predictions_once(params) {
+    let departures_url = new URL(TRANSSEE_URL);
+    departures_url.search = params;
 
     const response = await fetch(departures_url).catch((e) => {
-        send_error(ErrorCode.NO_CONNECTION);
-        throw e;
+        throw fetch_error(String(e), ErrorCode.NO_CONNECTION);
     });
     if (response.status == 500) {
         // sometimes this means invalid API key
-        send_error(ErrorCode.UNKNOWN_API_ERROR);
         const text = await response.text();
         console.log(text);
-        throw new Error(text);
+        throw fetch_error(text, ErrorCode.UNKNOWN_API_ERROR);
     }
     const json = await response.json().catch((e) => {
         console.log('Error parsing JSON from TransSee predictions request');
-        send_error(ErrorCode.UNKNOWN_API_ERROR);
-        throw e;
+        throw fetch_error(String(e), ErrorCode.UNKNOWN_API_ERROR);
     });
 
     return json.predictions;
 }
 
-async function get_departures_for_watch_with_stops(stops) {
-    console.log("Obtaining departures for the following stops: " + JSON.stringify(stops));
-    const transsee_departures_by_index = await Promise.all(stops.map(get_departures_transsee));
-    const transsee_departures_by_stop = transsee_departures_by_index.map(
-        (departures, index) => [stops[index], departures]);
+// retried until it works, MAX_ATTEMPTS is reached or `deadline` passes
+async function fetch_transsee_predictions(params, deadline) {
+    let error = fetch_error("Out of time", ErrorCode.NO_CONNECTION);
+    for (let attempt = 1; attempt <= MAX_ATTEMPTS; attempt += 1) {
+        const remaining_ms = deadline - Date.now();
+        if (remaining_ms <= 0) {
+            break;
+        }
+        try {
+            return await with_timeout(fetch_transsee_predictions_once(params),
+                Math.min(REQUEST_TIMEOUT_MS, remaining_ms));
+        } catch (e) {
+            console.log("TransSee request failed (attempt " + attempt + "): " + e.message);
+            error = e;
+        }
+    }
+    throw error;
+}
+
+function check_transsee_userid() {
+    if (!apikey.hasOwnProperty("TRANSSEE_USERID")) {
+        throw new Error("TRANSSEE_USERID is not set");
+    }
+}
+
+async function get_departures_transsee(stop, deadline) {
+    check_transsee_userid();
+    return await fetch_transsee_predictions(new URLSearchParams({
+        "command": "predictions",
+        "premium": apikey.TRANSSEE_USERID,
+        "a": stop.agency,
+        "stopId": stop.stop_code,
+    }), deadline);
+}
 
+/*
+One predictionsForMultiStops request for every stop of an agency that
+has stop tags (see corrections.stop_tag), split only if the URL would
+get too long. Returns the predictions for each stop, in order; a
+{route tag}|{stop tag} asked for by more than one stop goes to the first.
+*/
+async function get_departures_transsee_multi(agency, stops, deadline) {
+    check_transsee_userid();
+    let stop_index_by_param = new Map();
+    stops.forEach((stop, index) => {
+        for (const stop_param of corrections.stop_tag[agency](stop)) {
+            if (!stop_index_by_param.has(stop_param)) {
+                stop_index_by_param.set(stop_param, index);
+            }
+        }
+    });
+
+    const base_params = () => new URLSearchParams({
+        "command": "predictionsForMultiStops",
+        "premium": apikey.TRANSSEE_USERID,
+        "a": agency,
+    });
+    let batches = [];
+    let params = null;
+    for (const stop_param of stop_index_by_param.keys()) {
+        const encoded_length = new URLSearchParams({ "stops": stop_param }).toString().length + 1;
+        if (params === null || TRANSSEE_URL.length + 1 + params.toString().length + encoded_length > MAX_URL_LENGTH) {
+            params = base_params();
+            batches.push(params);
+        }
+        params.append("stops", stop_param);
+    }
+
+    const predictions = (await Promise.all(
+        batches.map((params) => fetch_transsee_predictions(params, deadline)))).flat();
+    let predictions_by_stop = stops.map(() => []);
+    for (const route of predictions) {
+        const index = stop_index_by_param.get(route.routeTag + "|" + route.stopTag);
+        if (index !== undefined) {
+            predictions_by_stop[index].push(route);
+        }
+    }
+    return predictions_by_stop;
+}
+
+/*
+Predictions for each stop, in the same order, with null for stops whose
+request failed or didn't finish by the deadline. Stops of agencies with
+stop tags are fetched together; the rest need one request each. Throws
+if nothing arrived at all. `on_progress`, if given, is called with the
+predictions so far each time a request finishes before the deadline.
+*/
+async function get_predictions_for_stops(stops, on_progress) {
+    const deadline = Date.now() + FETCH_DEADLINE_MS;
+    let stops_by_agency = new Map();
+    let requests = [];
+    stops.forEach((stop, index) => {
+        if (corrections.stop_tag.hasOwnProperty(stop.agency)) {
+            if (!stops_by_agency.has(stop.agency)) {
+                stops_by_agency.set(stop.agency, []);
+            }
+            stops_by_agency.get(stop.agency).push(index);
+        } else {
+            requests.push(get_departures_transsee(stop, deadline).then((predictions) => [[index, predictions]]));
+        }
+    });
+    for (const [agency, indices] of stops_by_agency) {
+        requests.push(get_departures_transsee_multi(agency, indices.map((index) => stops[index]), deadline).then(
+            (predictions_by_stop) => predictions_by_stop.map((predictions, i) => [indices[i], predictions])));
+    }
+    console.log("Fetching predictions for " + stops.length + " stops in " + requests.length + " requests");
+
+    let predictions_by_stop = stops.map(() => null);
+    let first_error = null;
+    let done = false;
+    let settled_count = 0;
+    const settled = requests.map((request) => request.then((results) => {
+        for (const [index, predictions] of results) {
+            predictions_by_stop[index] = predictions;
+        }
+        if (on_progress && !done && settled_count < requests.length - 1) {
+            on_progress(predictions_by_stop);
+        }
+        settled_count += 1;
+    }, (e) => {
+        settled_count += 1;
+        first_error = first_error || e;
+    }));
+    let deadline_timer;
+    await Promise.race([
+        Promise.all(settled),
+        new Promise((resolve) => {
+            deadline_timer = setTimeout(resolve, Math.max(0, deadline - Date.now()));
+        }),
+    ]);
+    clearTimeout(deadline_timer);
+    done = true;
+
+    if (predictions_by_stop.every((predictions) => predictions === null)) {
+        throw first_error || fetch_error("No predictions arrived in time", ErrorCode.NO_CONNECTION);
+    }
+    return predictions_by_stop;
+}
+
+function stop_key(stop) {
+    return stop.agency + "|" + stop.stop_id;
+}
+
+/*
+Turns the predictions for each stop into departures for the watch, best
+first (see ranking.js). `here` is { lat, lon } where the stops were looked
+up from, for walking distances. If some stops have no predictions (null)
+their departures from the last message are kept and `partial` is set.
+*/
+function watch_data_for_predictions(stops, here, predictions_by_stop) {
     let departures_for_watch = [];
-    for ([stop, dep] of transsee_departures_by_stop) {
+    let partial = false;
+    for (const [index, stop] of stops.entries()) {
+        const dep = predictions_by_stop[index];
+        const walk_m = here ? distance_m(here.lat, here.lon, stop.stop_lat, stop.stop_lon) : 0;
+        if (dep === null) {
+            partial = true;
+            if (current_result !== null) {
+                const key = stop_key(stop);
+                departures_for_watch.push(...current_result.departures.filter((watch_data) => watch_data.stop_key == key));
+            }
+            continue;
+        }
         for (route of dep) {
             if (!route.hasOwnProperty("direction")) continue;
             for (direction of route.direction) {
@@ -202,7 +451,10 @@ async function get_departures_for_watch_with_stops(stops) {
                 }
                 if (!direction.hasOwnProperty("prediction")) continue;
                 try {
-                    departures_for_watch.push(transsee_dep_to_watch_data(stop, route, direction.title, direction.prediction[0]));
+                    let watch_data = transsee_dep_to_watch_data(stop, route, direction.title, direction.prediction);
+                    // not sent, used for ranking
+                    watch_data.walk_m = walk_m;
+                    departures_for_watch.push(watch_data);
                 } catch (e) {
                     console.log("Failed to serialize route to watch data: " + JSON.stringify(route));
                     throw e;
@@ -210,29 +462,88 @@ async function get_departures_for_watch_with_stops(stops) {
             }
         }
     }
-    return departures_for_watch;
+    return {
+        "departures": rank_departures(departures_for_watch, MAX_RANKED_DEPARTURES, Date.now() / 1000),
+        "partial": partial,
+    };
 }
 
-async function get_departures_for_watch(lat, lon, radius) {
-    const stops = await get_stops(lat, lon, radius);
+/*
+Resolves to { departures, partial }. With `stream` set, departures are
+sent to the watch as the stops answer: first the best one on its own so
+there's something on screen, then everything so far, each marked as
+having more to come. The caller still sends the final result.
+*/
+async function get_departures_for_watch_with_stops(stops, here, stream) {
+    console.log("Obtaining departures for the following stops: " + JSON.stringify(stops));
+    let streamed_any = false;
+    const on_progress = !stream ? null : function(predictions_by_stop) {
+        let result = watch_data_for_predictions(stops, here, predictions_by_stop);
+        if (result.departures.length == 0) {
+            return;
+        }
+        if (!streamed_any) {
+            result.departures = result.departures.slice(0, 1);
+            streamed_any = true;
+        }
+        result.more = true;
+        send_to_watch(result, null);
+    };
+    const predictions_by_stop = await get_predictions_for_stops(stops, on_progress).catch((e) => {
+        send_error(e.error_code || ErrorCode.UNKNOWN_API_ERROR);
+        throw e;
+    });
+    return watch_data_for_predictions(stops, here, predictions_by_stop);
+}
+
+/*
+Optional: with `exports.OFFLINE_STOPS = [{ "agency": ..., "url": ... }]`
+in apikey.js, nearby stops are looked up in a local index built from
+those GTFS stops.txt files instead of asking the stops API
+*/
+function update_stop_index() {
+    if (!apikey.hasOwnProperty("OFFLINE_STOPS") || stop_index.age_ms() < STOP_INDEX_MAX_AGE_MS) {
+        return;
+    }
+    stop_index.rebuild(apikey.OFFLINE_STOPS).catch((e) => {
+        console.log("Couldn't build the offline stop index: " + e);
+    });
+}
+
+async function get_departures_for_watch(lat, lon, radius, stream) {
+    let stops = stop_index.available() ? stop_index.nearest(lat, lon, NUM_STOPS) : [];
+    if (stops.length == 0) {
+        stops = stop_cache.get(lat, lon);
+    }
+    if (stops === null) {
+        stops = await get_stops(lat, lon, radius);
+        if (stops.length > 0) {
+            stop_cache.put(lat, lon, stops);
+        }
+    }
     // store for later
+    const here = { "lat": lat, "lon": lon };
     localStorage.setItem("stops", JSON.stringify(stops));
+    localStorage.setItem("stops_location", JSON.stringify(here));
 
-    return await get_departures_for_watch_with_stops(stops);
+    return await get_departures_for_watch_with_stops(stops, here, stream);
 }
 
 async function refresh_departures_for_watch() {
     const stops = JSON.parse(localStorage.getItem("stops"));
+    const here = JSON.parse(localStorage.getItem("stops_location"));
 
-    return await get_departures_for_watch_with_stops(stops);
+    return await get_departures_for_watch_with_stops(stops, here);
 }
 
 function get_location_and_routes() {
     const location_success = function(pos) {
         console.log('lat= ' + pos.coords.latitude + ' lon= ' + pos.coords.longitude);
 
-        get_departures_for_watch(pos.coords.latitude, pos.coords.longitude, SEARCH_RADIUS_M).then(
-            (departures_for_watch) => send_to_watch(departures_for_watch));
+        // stream the departures in as the stops answer, the watch has nothing to show yet
+        const stream = true;
+        get_departures_for_watch(pos.coords.latitude, pos.coords.longitude, SEARCH_RADIUS_M, stream).then(
+            (result) => send_to_watch(result, null)).finally(update_stop_index);
     }
 
     const location_error = function(err) {
@@ -263,9 +574,25 @@ Pebble.addEventListener('ready', function() {
 });
 
 Pebble.addEventListener('appmessage', function(event) {
-    // PebbleKit JS is ready!
-    console.log('Refreshing');
+    const watch_seq = event.payload.hasOwnProperty("seq") ? event.payload.seq : 0;
+    if (event.payload.hasOwnProperty("page_offset")) {
+        // the watch scrolled near the edge of its window, no need to fetch anything
+        console.log('Watch asked for departures from ' + event.payload.page_offset + ', it has seq ' + watch_seq);
+        window_offset = event.payload.page_offset;
+        if (current_result !== null) {
+            send_window(watch_seq);
+        }
+        return;
+    }
+    if (event.payload.hasOwnProperty("needs_snapshot") && current_result !== null) {
+        // the watch couldn't apply a delta, the list it missed is still here;
+        // other refreshes with seq 0 (after an error, say) fetch as usual
+        console.log('Watch needs a snapshot, resending departures from ' + window_offset);
+        send_window(0);
+        return;
+    }
+    console.log('Refreshing, watch has seq ' + watch_seq);
 
     refresh_departures_for_watch().then(
-            (departures_for_watch) => send_to_watch(departures_for_watch));
+            (result) => send_to_watch(result, watch_seq));
 });
\ No newline at end of file
@@ -0,0 +1,243 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+// packed departures format, decoded by src/c/message.c
+const MESSAGE_FORMAT_VERSION = 7;
+const MAX_STRING_BYTES = 31;
+// departures the watch holds at once, WINDOW_SIZE in src/c/message.h
+const WINDOW_SIZE = 12;
+exports.WINDOW_SIZE = WINDOW_SIZE;
+// string pool on the watch, STRING_POOL_BYTES in src/c/message.h
+const STRING_POOL_BYTES = 1024;
+// later arrivals sent with each departure, MAX_NEXT_ARRIVALS in src/c/data.h
+const MAX_NEXT_ARRIVALS = 3;
+exports.MAX_NEXT_ARRIVALS = MAX_NEXT_ARRIVALS;
+
+const MessageType = {
+    "SNAPSHOT": 0,
+    "DELTA": 1,
+};
+
+const MessageFlag = {
+    // some stops didn't answer in time, so departures for them may be old or missing
+    "PARTIAL": 1,
+    // more departures are on their way in another message
+    "MORE": 2,
+};
+
+/*
+`header` is { partial, more, offset, total }: the flags, then where the
+departures in this message start in the phone's full list and how long
+that list is
+*/
+function push_header(bytes, type, seq, header) {
+    bytes.push(MESSAGE_FORMAT_VERSION, type);
+    push_int16(bytes, seq);
+    bytes.push((header.partial ? MessageFlag.PARTIAL : 0) | (header.more ? MessageFlag.MORE : 0));
+    push_int16(bytes, header.offset);
+    push_int16(bytes, header.total);
+}
+
+function utf8_bytes(str) {
+    let bytes = [];
+    for (const char of str) {
+        const code = char.codePointAt(0);
+        if (code < 0x80) {
+            bytes.push(code);
+        } else if (code < 0x800) {
+            bytes.push(0xc0 | (code >> 6), 0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            bytes.push(0xe0 | (code >> 12), 0x80 | ((code >> 6) & 0x3f), 0x80 | (code & 0x3f));
+        } else {
+            bytes.push(0xf0 | (code >> 18), 0x80 | ((code >> 12) & 0x3f),
+                0x80 | ((code >> 6) & 0x3f), 0x80 | (code & 0x3f));
+        }
+    }
+    return bytes;
+}
+
+function encode_string(str) {
+    let encoded = utf8_bytes(str);
+    if (encoded.length > MAX_STRING_BYTES) {
+        // cut on a character boundary so the watch never sees half a character
+        let len = MAX_STRING_BYTES;
+        while (len > 0 && (encoded[len] & 0xc0) == 0x80) {
+            len -= 1;
+        }
+        encoded = encoded.slice(0, len);
+    }
+    return encoded;
+}
+
+function push_int16(bytes, value) {
+    bytes.push(value & 0xff, (value >> 8) & 0xff);
+}
+
+function push_uint32(bytes, value) {
+    bytes.push(value & 0xff, (value >>> 8) & 0xff, (value >>> 16) & 0xff, (value >>> 24) & 0xff);
+}
+
+/*
+The arrival time, then the later arrivals as whole minutes after the
+one before. The gaps are taken between minutes counted from `arrival`
+so adding them up on the watch never drifts from rounding.
+*/
+function push_arrivals(bytes, watch_data) {
+    push_uint32(bytes, watch_data.arrival);
+    const next_arrivals = (watch_data.next_arrivals || []).slice(0, MAX_NEXT_ARRIVALS);
+    bytes.push(next_arrivals.length);
+    let previous_minutes = 0;
+    for (const next_arrival of next_arrivals) {
+        const minutes = Math.max(previous_minutes, Math.round((next_arrival - watch_data.arrival) / 60));
+        const gap = Math.min(minutes - previous_minutes, 0xff);
+        bytes.push(gap);
+        previous_minutes += gap;
+    }
+}
+
+/*
+Every distinct string in a message is sent once and records refer to
+it by index. Strings are compared after truncation, so two names that
+only differ past the limit share an entry.
+*/
+class StringTable {
+    constructor() {
+        this.index_by_string = new Map();
+        this.encoded = [];
+        // what the strings take up in the watch's pool, NUL terminators included
+        this.pool_bytes = 0;
+    }
+
+    index_of(str) {
+        const encoded = encode_string(str);
+        const key = String.fromCharCode.apply(null, encoded);
+        if (!this.index_by_string.has(key)) {
+            this.index_by_string.set(key, this.encoded.length);
+            this.encoded.push(encoded);
+            this.pool_bytes += encoded.length + 1;
+        }
+        return this.index_by_string.get(key);
+    }
+
+    push_to(bytes) {
+        bytes.push(this.encoded.length);
+        for (const encoded of this.encoded) {
+            bytes.push(encoded.length);
+            for (const byte of encoded) {
+                bytes.push(byte);
+            }
+        }
+    }
+}
+
+function push_departures(bytes, departures) {
+    let strings = new StringTable();
+    let records = [];
+    for (const watch_data of departures) {
+        let record = [];
+        push_int16(record, watch_data.id);
+        push_arrivals(record, watch_data);
+        record.push(
+            watch_data.vehicle_type,
+            watch_data.color & 0xff,
+            watch_data.shape,
+            strings.index_of(watch_data.unit),
+            strings.index_of(watch_data.stop_name),
+            strings.index_of(watch_data.dest_name),
+            strings.index_of(watch_data.route_number),
+            strings.index_of(watch_data.route_name));
+        records.push(record);
+    }
+    strings.push_to(bytes);
+    bytes.push(records.length);
+    for (const record of records) {
+        for (const byte of record) {
+            bytes.push(byte);
+        }
+    }
+}
+
+// everything except the arrival times, which deltas send separately
+function same_record(a, b) {
+    return a.unit == b.unit
+        && a.stop_name == b.stop_name
+        && a.dest_name == b.dest_name
+        && a.route_number == b.route_number
+        && a.route_name == b.route_name
+        && a.vehicle_type == b.vehicle_type
+        && a.color == b.color
+        && a.shape == b.shape;
+}
+
+/*
+The longest start of `departures` whose strings fit the watch's string
+pool in one snapshot. The pool is sized for how much departures usually
+share, so a window of long names that share nothing is cut short here
+instead of being sent for the watch to reject. A single departure always
+fits.
+*/
+exports.fit_string_pool = function(departures) {
+    let strings = new StringTable();
+    let count = 0;
+    for (const watch_data of departures) {
+        strings.index_of(watch_data.unit);
+        strings.index_of(watch_data.stop_name);
+        strings.index_of(watch_data.dest_name);
+        strings.index_of(watch_data.route_number);
+        strings.index_of(watch_data.route_name);
+        if (strings.pool_bytes > STRING_POOL_BYTES) {
+            break;
+        }
+        count += 1;
+    }
+    return departures.slice(0, count);
+}
+
+exports.encode_snapshot = function(seq, departures, header) {
+    let bytes = [];
+    push_header(bytes, MessageType.SNAPSHOT, seq, header);
+    push_departures(bytes, departures);
+    return bytes;
+}
+
+/*
+A delta lists the id and arrival times of every departure in the new order, then
+full records only for departures the watch doesn't have or whose
+other fields changed. Departures missing from the list are removed.
+*/
+exports.encode_delta = function(base_seq, seq, previous, departures, header) {
+    let previous_by_id = new Map();
+    for (const watch_data of previous) {
+        previous_by_id.set(watch_data.id, watch_data);
+    }
+
+    let bytes = [];
+    push_header(bytes, MessageType.DELTA, seq, header);
+    push_int16(bytes, base_seq);
+    bytes.push(departures.length);
+    let records = [];
+    for (const watch_data of departures) {
+        push_int16(bytes, watch_data.id);
+        push_arrivals(bytes, watch_data);
+        const old = previous_by_id.get(watch_data.id);
+        if (old === undefined || !same_record(old, watch_data)) {
+            records.push(watch_data);
+        }
+    }
+    push_departures(bytes, records);
+    return bytes;
+}
+
+// FNV-1a folded to 16 bits, never 0
+exports.departure_id = function(key) {
+    let hash = 0x811c9dc5;
+    for (let i = 0; i < key.length; i += 1) {
+        hash ^= key.charCodeAt(i);
+        hash = Math.imul(hash, 0x01000193) >>> 0;
+    }
+    const id = ((hash >>> 16) ^ hash) & 0xffff;
+    return id == 0 ? 1 : id;
+}
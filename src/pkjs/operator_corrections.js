@@ -6,62 +6,150 @@ file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
 const { VehicleType, RouteShape, GColor } = require("./data");
 const { titleCaps } = require("./title_caps");
-const keys = require('message_keys');
 
 const TTC_SUBWAY_STATIONS = new Set(['14111', '13789', '13860', '13792', '13793', '13795', '13798', '13799', '13802', '13803', '13864', '13806', '13807', '13810', '13811', '13814', '13815', '13817', '13820', '13821', '13824', '13825', '13858', '13853', '13828', '13829', '13832', '13833', '13836', '13837', '13840', '14945', '15664', '15659', '15666', '15656', '15661', '15662', '15663', '15660', '15657', '15667', '15658', '15665', '14110', '13839', '13838', '13835', '13834', '13831', '13830', '13827', '13854', '13857', '13826', '13823', '13822', '13819', '13818', '13816', '13813', '13812', '13809', '13808', '13805', '13863', '13804', '13801', '13800', '13797', '13796', '13794', '13791', '13859', '13790', '14944', '13785', '13784', '13781', '13780', '13777', '13776', '13773', '13772', '13769', '13768', '13765', '13764', '13761', '13760', '13852', '13856', '13757', '13756', '13753', '13752', '13749', '13748', '13746', '13743', '13742', '13739', '13738', '13735', '13734', '13732', '14947', '13865', '13731', '13733', '13736', '13737', '13740', '13741', '13744', '13745', '13747', '13750', '13751', '13754', '13755', '13758', '13855', '13851', '13759', '13762', '13763', '13766', '13767', '13770', '13771', '13774', '13775', '13778', '13779', '13782', '13783', '14948', '13862', '13844', '13845', '13848', '14949', '14109', '13847', '13846', '13843', '13861']);
 const GO_TRAIN_STATIONS = new Set(['AL', 'MP', 'ET', 'SM', 'SF', 'OA', 'DA', 'RU', 'RI', 'SC', 'DW', 'MI', 'ST', 'UN', 'AP', 'LN', 'WR', 'CL', 'GU', 'OL', 'MK', 'ER', 'MJ', 'MA', 'SCTH', 'OS', 'AJ', 'UI', 'EX', 'AC', 'KC', 'LS', 'EG', 'WE', 'RO', 'BR', 'BO', 'GL', 'ME', 'AD', 'LO', 'HA', 'OR', 'DI', 'BU', 'SR', 'PO', 'GE', 'BD', 'KI', 'AG', 'BE', 'WH', 'GO', 'KP', 'NI', 'ML', 'KE', 'MO', 'MR', 'BA', 'EA', 'BL', 'CE', 'LI', 'BM', 'LA', 'NE', 'PIN', 'AU', 'CO'])
 
-exports.transsee = {
-    "Toronto TTC": function(stop, route, direction, prediction, watch_data) {
-        const route_number = parseInt(route.routeTag);
-        if (1 <= route_number && route_number <= 6) {
-            watch_data[keys.shape] = RouteShape.CIRCLE;
-            watch_data[keys.vehicle_type] = VehicleType.SUBWAY;
-        }
-        if (["501", "502", "503", "504", "504A", "504B", "505", "506",
-            "507", "508", "509", "510", "511", "512", "513", "514",
-            "301", "304", "306", "310"].includes(route.routeTag)) {
-            watch_data[keys.vehicle_type] = VehicleType.STREETCAR;
-        }
+// GO directions look like "21 - Milton - Union Station"
+function split_go_direction(direction) {
+    const [route_number, ...rest] = direction.split(" - ");
+    return { route_number: route_number, dest_name: "to " + rest.join(" - ") };
+}
 
-        // not sure how to fix something like this other than making a special case for everything
-        if (prediction.dirTag.split("_")[2] == "506Cbus") {
-            watch_data[keys.route_number] = "506C";
-            watch_data[keys.vehicle_type] = VehicleType.BUS;
-        }
+/*
+Per-agency corrections to the departures TransSee gives us, as rule
+tables keyed by agency title. They're compiled once below, and the
+results for each route and stop are remembered since the same ones come
+back on every refresh.
 
+    defaults:   fields set on every departure
+    routes:     { tags, range, set } applied to departures whose route tag
+                is in `tags` or whose route number is within `range`
+    dir_tags:   { part, value, set } applied when the `part`th
+                underscore-separated piece of prediction.dirTag is `value`
+    stop_name,
+    route_name: [regex, replacement] pairs applied in order
+    direction:  function(direction) returning fields that depend on the
+                direction title
+*/
+const TRANSSEE_RULES = {
+    "Toronto TTC": {
+        routes: [
+            { range: [1, 6], set: { shape: RouteShape.CIRCLE, vehicle_type: VehicleType.SUBWAY } },
+            {
+                tags: ["501", "502", "503", "504", "504A", "504B", "505", "506",
+                    "507", "508", "509", "510", "511", "512", "513", "514",
+                    "301", "304", "306", "310"],
+                set: { vehicle_type: VehicleType.STREETCAR },
+            },
+        ],
+        // not sure how to fix something like this other than making a special case for everything
+        dir_tags: [
+            { part: 2, value: "506Cbus", set: { route_number: "506C", vehicle_type: VehicleType.BUS } },
+        ],
         // make the stop name a little shorter
-        watch_data[keys.stop_name] = watch_data[keys.stop_name].replaceAll(/ (St|Av|Ave|Dr|Rd)( East| West)? at /g, " / ")
-            .replaceAll(/ (St|Av|Ave|Dr|Rd)( East| West)?$/g, "");
-
-        watch_data[keys.route_name] = watch_data[keys.route_name].replace(/LINE \d \((.+)\)/, "$1");
+        stop_name: [
+            [/ (St|Av|Ave|Dr|Rd)( East| West)? at /g, " / "],
+            [/ (St|Av|Ave|Dr|Rd)( East| West)?$/g, ""],
+        ],
+        route_name: [
+            [/LINE \d \((.+)\)/, "$1"],
+        ],
     },
-    "Toronto TTC Subway": function(stop, route, direction, prediction, watch_data) {
-
+    "Toronto TTC Subway": {},
+    "GO Transit": {
+        defaults: { shape: RouteShape.RECT },
+        direction: split_go_direction,
     },
-    "GO Transit": function(stop, route, direction, prediction, watch_data) {
-        watch_data[keys.shape] = RouteShape.RECT;
-        
-        const [route_number, ...rest] = direction.split(" - ");
-        watch_data[keys.route_number] = route_number;
-        watch_data[keys.dest_name] = "to " + rest.join(" - ");
+    "GO Trains": {
+        defaults: { shape: RouteShape.RECT, vehicle_type: VehicleType.REGIONAL_TRAIN },
+        direction: split_go_direction,
     },
-    "GO Trains": function(stop, route, direction, prediction, watch_data) {
-        watch_data[keys.shape] = RouteShape.RECT;
-        watch_data[keys.vehicle_type] = VehicleType.REGIONAL_TRAIN;
-
-        const [route_number, ...rest] = direction.split(" - ");
-        watch_data[keys.route_number] = route_number;
-        watch_data[keys.dest_name] = "to " + rest.join(" - ");
+    "Kitchener-Waterloo GRT": {
+        routes: [
+            { tags: ["301"], set: { vehicle_type: VehicleType.STREETCAR } },
+        ],
     },
-    "Kitchener-Waterloo GRT": function(stop, route, direction, prediction, watch_data) {
-        if (route.routeTag == "301") {
-            watch_data[keys.vehicle_type] = VehicleType.STREETCAR;
-        }
+    "UP Express": {
+        defaults: { shape: RouteShape.RECT, vehicle_type: VehicleType.REGIONAL_TRAIN },
     },
-    "UP Express": function(stop, route, direction, prediction, watch_data) {
-        watch_data[keys.shape] = RouteShape.RECT;
-        watch_data[keys.vehicle_type] = VehicleType.REGIONAL_TRAIN;
+};
+
+function apply_replacements(replacements, str) {
+    for (const [regex, replacement] of replacements) {
+        str = str.replace(regex, replacement);
+    }
+    return str;
+}
+
+function memoised(fn) {
+    let cache = new Map();
+    return function(key, ...args) {
+        if (!cache.has(key)) {
+            cache.set(key, fn(...args));
+        }
+        return cache.get(key);
+    };
+}
+
+function compile_agency(rules) {
+    const routes = (rules.routes || []).map((rule) => ({
+        "tags": new Set(rule.tags || []),
+        "range": rule.range,
+        "set": rule.set,
+    }));
+    const dir_tags = new Map((rules.dir_tags || []).map((rule) => [rule.part + "|" + rule.value, rule.set]));
+    const dir_tag_parts = new Set((rules.dir_tags || []).map((rule) => rule.part));
+    const stop_name = rules.stop_name || [];
+    const route_name = rules.route_name || [];
+
+    // everything that only depends on the route: the fields to set and the route name
+    const route_fields = memoised(function(route_tag, name) {
+        let fields = Object.assign({}, rules.defaults);
+        const route_number = parseInt(route_tag);
+        for (const rule of routes) {
+            if (rule.tags.has(route_tag)
+                || (rule.range && rule.range[0] <= route_number && route_number <= rule.range[1])) {
+                Object.assign(fields, rule.set);
+            }
+        }
+        fields.route_name = apply_replacements(route_name, name);
+        return fields;
+    });
+    const stop_fields = memoised((name) => ({ "stop_name": apply_replacements(stop_name, name) }));
+    const dir_tag_fields = memoised(function(dir_tag) {
+        let fields = {};
+        if (dir_tag !== undefined) {
+            const parts = dir_tag.split("_");
+            for (const part of dir_tag_parts) {
+                Object.assign(fields, dir_tags.get(part + "|" + parts[part]));
+            }
+        }
+        return fields;
+    });
+    const direction_fields = rules.direction ? memoised(rules.direction) : null;
+
+    return function(stop, route, direction, prediction, watch_data) {
+        Object.assign(watch_data, route_fields(route.routeTag + "|" + watch_data.route_name,
+            route.routeTag, watch_data.route_name));
+        if (dir_tags.size > 0) {
+            Object.assign(watch_data, dir_tag_fields(prediction.dirTag, prediction.dirTag));
+        }
+        Object.assign(watch_data, stop_fields(stop.stop_id + "|" + watch_data.stop_name, watch_data.stop_name));
+        if (direction_fields !== null) {
+            Object.assign(watch_data, direction_fields(direction, direction));
+        }
+    };
+}
+
+const compiled_transsee = new Map(
+    Object.entries(TRANSSEE_RULES).map(([agency, rules]) => [agency, compile_agency(rules)]));
+
+// correct `watch_data` in place for the agency the route belongs to
+exports.apply_transsee = function(stop, route, direction, prediction, watch_data) {
+    const apply = compiled_transsee.get(route.agencyTitle);
+    if (apply !== undefined) {
+        apply(stop, route, direction, prediction, watch_data);
     }
 }
 
@@ -0,0 +1,136 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+// picks which departures are worth showing, and in what order
+
+const WALKING_M_PER_MIN = 80;
+// a minute of walking counts for a bit more than a minute of waiting
+const WALK_WEIGHT = 0.5;
+// you'd have to run for it, or it's already gone
+const UNREACHABLE_PENALTY_MIN = 30;
+// a route you've already got, going the other way (or to another branch)
+const REPEAT_ROUTE_PENALTY_MIN = 15;
+
+/*
+Lower is better: how long until you could be on it, plus a bit for the
+walk. Departures that leave before you could walk to the stop sink
+below everything reachable.
+*/
+function score(watch_data, now_s) {
+    const minutes = (watch_data.arrival - now_s) / 60;
+    const walk_minutes = (watch_data.walk_m || 0) / WALKING_M_PER_MIN;
+    let result = Math.max(minutes, walk_minutes) + WALK_WEIGHT * walk_minutes;
+    if (minutes < walk_minutes) {
+        result += UNREACHABLE_PENALTY_MIN;
+    }
+    return result;
+}
+
+/*
+Binary max-heap on score holding the k best (lowest) entries seen, so
+picking them is O(n log k) without sorting everything
+*/
+class BoundedHeap {
+    constructor(k) {
+        this.k = k;
+        this.entries = [];
+    }
+
+    worse(i, j) {
+        return this.entries[i].score > this.entries[j].score;
+    }
+
+    swap(i, j) {
+        const tmp = this.entries[i];
+        this.entries[i] = this.entries[j];
+        this.entries[j] = tmp;
+    }
+
+    sift_up(i) {
+        while (i > 0) {
+            const parent = (i - 1) >> 1;
+            if (!this.worse(i, parent)) {
+                return;
+            }
+            this.swap(i, parent);
+            i = parent;
+        }
+    }
+
+    sift_down(i) {
+        const n = this.entries.length;
+        while (true) {
+            let largest = i;
+            for (const child of [2 * i + 1, 2 * i + 2]) {
+                if (child < n && this.worse(child, largest)) {
+                    largest = child;
+                }
+            }
+            if (largest == i) {
+                return;
+            }
+            this.swap(i, largest);
+            i = largest;
+        }
+    }
+
+    push(entry) {
+        if (this.entries.length < this.k) {
+            this.entries.push(entry);
+            this.sift_up(this.entries.length - 1);
+        } else if (this.k > 0 && entry.score < this.entries[0].score) {
+            this.entries[0] = entry;
+            this.sift_down(0);
+        }
+    }
+
+    // best first
+    sorted() {
+        return this.entries.slice().sort((a, b) => a.score - b.score);
+    }
+}
+
+function route_key(watch_data) {
+    return watch_data.route_number + "|" + watch_data.vehicle_type;
+}
+
+/*
+The best `k` departures, best first. The same route in the same
+direction often shows up at several nearby stops (both corners of an
+intersection, say); only the best of those is kept. The same route in
+the other direction usually turns up too, across the street; it's kept,
+since it may be the way you're going, but it sinks below other routes.
+*/
+exports.rank_departures = function(departures, k, now_s) {
+    let best_by_direction = new Map();
+    for (const watch_data of departures) {
+        const entry = { "score": score(watch_data, now_s), "watch_data": watch_data };
+        const key = route_key(watch_data) + "|" + watch_data.dest_name;
+        const existing = best_by_direction.get(key);
+        if (existing === undefined || entry.score < existing.score) {
+            best_by_direction.set(key, entry);
+        }
+    }
+
+    let best_by_route = new Map();
+    for (const entry of best_by_direction.values()) {
+        const key = route_key(entry.watch_data);
+        const existing = best_by_route.get(key);
+        if (existing === undefined || entry.score < existing.score) {
+            best_by_route.set(key, entry);
+        }
+    }
+
+    let heap = new BoundedHeap(k);
+    for (const entry of best_by_direction.values()) {
+        if (best_by_route.get(route_key(entry.watch_data)) === entry) {
+            heap.push(entry);
+        } else {
+            heap.push({ "score": entry.score + REPEAT_ROUTE_PENALTY_MIN, "watch_data": entry.watch_data });
+        }
+    }
+    return heap.sorted().map((entry) => entry.watch_data);
+}
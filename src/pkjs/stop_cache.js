@@ -0,0 +1,89 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+const { distance_m } = require('./geo');
+
+/*
+Nearby stops, remembered by the grid cell they were looked up from so
+launching in the same place can skip the stops API. A cached set is only
+used if it's younger than the TTL and was looked up within
+MOVEMENT_THRESHOLD_M of where we are now, since the stops are sorted by
+distance from that point.
+*/
+const STORAGE_KEY = "stop_cache";
+// about 280 m north-south; a bit less east-west away from the equator
+const CELL_DEG = 0.0025;
+const TTL_MS = 24 * 60 * 60 * 1000;
+const MOVEMENT_THRESHOLD_M = 150;
+const MAX_ENTRIES = 16;
+
+function cell_of(lat, lon) {
+    return [Math.floor(lat / CELL_DEG), Math.floor(lon / CELL_DEG)];
+}
+
+function cell_key(cell_lat, cell_lon) {
+    return cell_lat + "," + cell_lon;
+}
+
+function load() {
+    try {
+        return JSON.parse(localStorage.getItem(STORAGE_KEY)) || {};
+    } catch (e) {
+        return {};
+    }
+}
+
+// the threshold can cross a cell edge, so look in the neighbouring cells too
+exports.get = function(lat, lon) {
+    const cache = load();
+    const now = Date.now();
+    const [cell_lat, cell_lon] = cell_of(lat, lon);
+    let best = null;
+    let best_distance = MOVEMENT_THRESHOLD_M;
+    for (let d_lat = -1; d_lat <= 1; d_lat += 1) {
+        for (let d_lon = -1; d_lon <= 1; d_lon += 1) {
+            const entry = cache[cell_key(cell_lat + d_lat, cell_lon + d_lon)];
+            if (entry === undefined || now - entry.time > TTL_MS) {
+                continue;
+            }
+            const distance = distance_m(lat, lon, entry.lat, entry.lon);
+            if (distance <= best_distance) {
+                best = entry;
+                best_distance = distance;
+            }
+        }
+    }
+    if (best !== null) {
+        console.log("Using cached stops from " + Math.round(best_distance) + " m away");
+        return best.stops;
+    }
+    return null;
+}
+
+exports.put = function(lat, lon, stops) {
+    let cache = load();
+    const now = Date.now();
+    const [cell_lat, cell_lon] = cell_of(lat, lon);
+    cache[cell_key(cell_lat, cell_lon)] = {
+        "lat": lat,
+        "lon": lon,
+        "time": now,
+        "stops": stops,
+    };
+
+    // drop expired entries, then the oldest ones if there are still too many
+    let keys = Object.keys(cache).filter((key) => now - cache[key].time <= TTL_MS);
+    keys.sort((a, b) => cache[b].time - cache[a].time);
+    let trimmed = {};
+    for (const key of keys.slice(0, MAX_ENTRIES)) {
+        trimmed[key] = cache[key];
+    }
+    try {
+        localStorage.setItem(STORAGE_KEY, JSON.stringify(trimmed));
+    } catch (e) {
+        console.log("Couldn't store stop cache: " + e);
+    }
+}
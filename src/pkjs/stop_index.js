@@ -0,0 +1,249 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+const { distance_m } = require('./geo');
+
+/*
+An optional offline copy of the stops, built from GTFS stops.txt files,
+so nearby stops can be found without the stops API. Stops are kept in
+localStorage as parallel columns (coordinates as integer 1e-5 degrees)
+and bucketed into a grid in memory when first queried. The stops it
+returns have the same fields as the stops API's.
+*/
+const STORAGE_KEY = "stop_index";
+const FORMAT_VERSION = 1;
+const COORD_SCALE = 100000;
+// about 1.1 km north-south
+const CELL_DEG = 0.01;
+const M_PER_DEG_LAT = 111320;
+// don't look further than this for stops
+const MAX_RADIUS_M = 5000;
+
+let s_index = null;
+
+// one record per line; handles quoted fields with commas, quotes and newlines
+function parse_csv(text) {
+    let rows = [];
+    let row = [];
+    let field = "";
+    let quoted = false;
+    for (let i = 0; i < text.length; i += 1) {
+        const c = text[i];
+        if (quoted) {
+            if (c == '"' && text[i + 1] == '"') {
+                field += '"';
+                i += 1;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            row.push(field);
+            field = "";
+        } else if (c == '\n' || c == '\r') {
+            if (c == '\r' && text[i + 1] == '\n') {
+                i += 1;
+            }
+            row.push(field);
+            rows.push(row);
+            row = [];
+            field = "";
+        } else {
+            field += c;
+        }
+    }
+    if (field != "" || row.length > 0) {
+        row.push(field);
+        rows.push(row);
+    }
+    return rows;
+}
+
+function empty_columns() {
+    return {
+        "version": FORMAT_VERSION,
+        "built": Date.now(),
+        "agencies": [],
+        "agency": [],
+        "stop_id": [],
+        "stop_code": [],
+        "stop_name": [],
+        "lat": [],
+        "lon": [],
+    };
+}
+
+// stations (location_type 1) and entrances aren't where vehicles stop
+function add_gtfs_stops(columns, agency, text) {
+    const rows = parse_csv(text.replace(/^\uFEFF/, ""));
+    if (rows.length == 0) {
+        return 0;
+    }
+    const header = rows[0].map((name) => name.trim());
+    const column = (name) => header.indexOf(name);
+    const id_col = column("stop_id");
+    const code_col = column("stop_code");
+    const name_col = column("stop_name");
+    const lat_col = column("stop_lat");
+    const lon_col = column("stop_lon");
+    const type_col = column("location_type");
+    if (id_col == -1 || name_col == -1 || lat_col == -1 || lon_col == -1) {
+        throw new Error("stops.txt for " + agency + " is missing required columns");
+    }
+
+    let agency_index = columns.agencies.indexOf(agency);
+    if (agency_index == -1) {
+        agency_index = columns.agencies.length;
+        columns.agencies.push(agency);
+    }
+    let added = 0;
+    for (const row of rows.slice(1)) {
+        if (row.length < header.length) {
+            continue;
+        }
+        if (type_col != -1 && row[type_col] != "" && row[type_col] != "0") {
+            continue;
+        }
+        const lat = parseFloat(row[lat_col]);
+        const lon = parseFloat(row[lon_col]);
+        if (isNaN(lat) || isNaN(lon)) {
+            continue;
+        }
+        columns.agency.push(agency_index);
+        columns.stop_id.push(row[id_col]);
+        columns.stop_code.push(code_col != -1 && row[code_col] != "" ? row[code_col] : row[id_col]);
+        columns.stop_name.push(row[name_col]);
+        columns.lat.push(Math.round(lat * COORD_SCALE));
+        columns.lon.push(Math.round(lon * COORD_SCALE));
+        added += 1;
+    }
+    return added;
+}
+
+function cell_key(cell_lat, cell_lon) {
+    return cell_lat + "," + cell_lon;
+}
+
+function build_grid(columns) {
+    let grid = new Map();
+    for (let i = 0; i < columns.lat.length; i += 1) {
+        const key = cell_key(
+            Math.floor(columns.lat[i] / COORD_SCALE / CELL_DEG),
+            Math.floor(columns.lon[i] / COORD_SCALE / CELL_DEG));
+        if (!grid.has(key)) {
+            grid.set(key, []);
+        }
+        grid.get(key).push(i);
+    }
+    return { "columns": columns, "grid": grid };
+}
+
+function load_index() {
+    if (s_index === null) {
+        let columns = null;
+        try {
+            columns = JSON.parse(localStorage.getItem(STORAGE_KEY));
+        } catch (e) {
+            console.log("Stop index is corrupt, ignoring it");
+        }
+        if (columns === null || columns.version != FORMAT_VERSION) {
+            return null;
+        }
+        s_index = build_grid(columns);
+    }
+    return s_index;
+}
+
+function stop_at(columns, i) {
+    return {
+        "agency": columns.agencies[columns.agency[i]],
+        "stop_id": columns.stop_id[i],
+        "stop_code": columns.stop_code[i],
+        "stop_name": columns.stop_name[i],
+        "stop_lat": columns.lat[i] / COORD_SCALE,
+        "stop_lon": columns.lon[i] / COORD_SCALE,
+    };
+}
+
+exports.available = function() {
+    return load_index() !== null;
+}
+
+exports.age_ms = function() {
+    const index = load_index();
+    return index === null ? Infinity : Date.now() - index.columns.built;
+}
+
+/*
+The k stops nearest to lat, lon, nearest first. Searches rings of grid
+cells outwards until the kth best stop is closer than anything the next
+ring could hold.
+*/
+exports.nearest = function(lat, lon, k) {
+    const index = load_index();
+    if (index === null) {
+        return [];
+    }
+    const columns = index.columns;
+    const cell_lat = Math.floor(lat / CELL_DEG);
+    const cell_lon = Math.floor(lon / CELL_DEG);
+    // the narrowest a cell gets, east-west, at this latitude
+    const cell_m = CELL_DEG * M_PER_DEG_LAT * Math.min(1, Math.cos((Math.abs(lat) + CELL_DEG) * Math.PI / 180));
+
+    let best = [];
+    const consider = function(i) {
+        const distance = distance_m(lat, lon, columns.lat[i] / COORD_SCALE, columns.lon[i] / COORD_SCALE);
+        if (best.length == k && distance >= best[k - 1].distance) {
+            return;
+        }
+        let at = best.length;
+        while (at > 0 && best[at - 1].distance > distance) {
+            at -= 1;
+        }
+        best.splice(at, 0, { "index": i, "distance": distance });
+        if (best.length > k) {
+            best.pop();
+        }
+    };
+
+    for (let ring = 0; ring * cell_m <= MAX_RADIUS_M; ring += 1) {
+        for (let d_lat = -ring; d_lat <= ring; d_lat += 1) {
+            for (let d_lon = -ring; d_lon <= ring; d_lon += 1) {
+                if (Math.abs(d_lat) != ring && Math.abs(d_lon) != ring) {
+                    continue;
+                }
+                const cell = index.grid.get(cell_key(cell_lat + d_lat, cell_lon + d_lon));
+                if (cell !== undefined) {
+                    cell.forEach(consider);
+                }
+            }
+        }
+        // anything beyond this ring is at least this far away
+        if (best.length == k && best[k - 1].distance <= ring * cell_m) {
+            break;
+        }
+    }
+    return best.filter((entry) => entry.distance <= MAX_RADIUS_M)
+        .map((entry) => stop_at(columns, entry.index));
+}
+
+/*
+Replace the index with the stops from `sources`, a list of
+{ "agency": TransSee agency tag, "url": GTFS stops.txt URL }
+*/
+exports.rebuild = async function(sources) {
+    let columns = empty_columns();
+    for (const source of sources) {
+        const response = await fetch(source.url);
+        const added = add_gtfs_stops(columns, source.agency, await response.text());
+        console.log("Indexed " + added + " stops for " + source.agency);
+    }
+    localStorage.setItem(STORAGE_KEY, JSON.stringify(columns));
+    s_index = build_grid(columns);
+}
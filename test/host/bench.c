@@ -0,0 +1,538 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+/*
+Replays the recorded payloads in payloads/ through the watch code and
+times the hot paths: receiving messages, stepping between departures,
+the route pill layout, a scroll transition and drawing a frame. The
+checks along the way make it fail (exit 1) when the behaviour breaks,
+not just when it gets slow.
+
+    make -C test/host run
+    BENCH_ITERATIONS=20000 make -C test/host run
+
+main.c is included rather than linked so its static state and
+callbacks can be driven directly.
+*/
+
+#define main watch_main
+#include "../../src/c/main.c"
+#undef main
+
+#include "host.h"
+#include "route_layout.h"
+
+#define DEFAULT_ITERATIONS 2000
+#define SCROLL_UPDATES 30
+
+typedef struct {
+    uint8_t* data;
+    size_t length;
+} Payload;
+
+static int s_failures = 0;
+
+#define CHECK(condition, ...) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fputc('\n', stderr); \
+        s_failures += 1; \
+    } \
+} while (0)
+
+static Payload load_payload(const char* name) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", PAYLOAD_DIR, name);
+    Payload payload = { .data = NULL, .length = 0 };
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(2);
+    }
+    uint8_t buffer[8192];
+    payload.length = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    payload.data = stub_malloc(payload.length);
+    memcpy(payload.data, buffer, payload.length);
+    return payload;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void report(const char* name, long operations, uint64_t elapsed_ns) {
+    printf("%-32s %10ld ops %10.1f ns/op\n", name, operations, (double)elapsed_ns / (double)operations);
+}
+
+static uint64_t receive(DictionaryIterator* iter, const Payload* payload) {
+    stub_dict_clear(iter);
+    stub_dict_add_data(iter, MESSAGE_KEY_departures, payload->data, payload->length);
+    const uint64_t start = now_ns();
+    inbox_received_callback(iter, NULL);
+    return now_ns() - start;
+}
+
+static bool strings_present(WindowDataArray* array) {
+    for (int i = 0; i < array->data_len; i += 1) {
+        WindowData* data = &array->array[i];
+        if (data->stop_name[0] == 0 || data->dest_name[0] == 0
+            || data->route_number[0] == 0 || data->route_name[0] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bench_inbox(int iterations, const Payload* snapshot, const Payload* delta_times, const Payload* delta_page) {
+    DictionaryIterator* iter = stub_dict_create();
+    uint64_t snapshot_ns = 0;
+    uint64_t delta_times_ns = 0;
+    uint64_t delta_page_ns = 0;
+    for (int i = 0; i < iterations; i += 1) {
+        snapshot_ns += receive(iter, snapshot);
+        if (i == 0) {
+            CHECK(sample_data_arr.data_len == WINDOW_SIZE, "snapshot gave %d departures", sample_data_arr.data_len);
+            CHECK(sample_data_arr.seq == 1, "snapshot seq %d", sample_data_arr.seq);
+            CHECK(strings_present(&sample_data_arr), "snapshot left empty strings");
+        }
+        delta_times_ns += receive(iter, delta_times);
+        if (i == 0) {
+            CHECK(sample_data_arr.seq == 2, "times delta not applied, seq %d", sample_data_arr.seq);
+            CHECK(sample_data_arr.array[0].num_next > 0, "times delta lost the later arrivals");
+        }
+        delta_page_ns += receive(iter, delta_page);
+        if (i == 0) {
+            CHECK(sample_data_arr.seq == 3, "page delta not applied, seq %d", sample_data_arr.seq);
+            CHECK(sample_data_arr.window_offset == WINDOW_SIZE / 2, "page delta at offset %d",
+                sample_data_arr.window_offset);
+            CHECK(strings_present(&sample_data_arr), "page delta left empty strings");
+        }
+    }
+    stub_dict_destroy(iter);
+    report("inbox snapshot", iterations, snapshot_ns);
+    report("inbox delta (times only)", iterations, delta_times_ns);
+    report("inbox delta (next window)", iterations, delta_page_ns);
+}
+
+static void bench_decode(int iterations, const Payload* snapshot) {
+    WindowDataArray array;
+    memset(&array, 0, sizeof(array));
+    CHECK(window_data_array_init(&array, WINDOW_SIZE, STRING_POOL_BYTES),
+        "couldn't allocate departures");
+    MessageType type;
+    const uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        message_decode_departures(&array, snapshot->data, snapshot->length, &type);
+    }
+    report("message_decode_departures", iterations, now_ns() - start);
+    CHECK(array.data_len == WINDOW_SIZE, "decode gave %d departures", array.data_len);
+    window_data_array_deinit(&array);
+}
+
+/*
+The pool only has room for the strings departures usually share. A
+snapshot of long names that share nothing is cut short by the phone to
+fit, and is rejected rather than shown with blank names if it isn't. A
+delta that would overflow the pool asks for a snapshot and leaves the
+departures as they were.
+*/
+static void check_string_pool(const Payload* snapshot, const Payload* long_strings,
+        const Payload* long_strings_fitted, const Payload* delta_long_strings) {
+    WindowDataArray array;
+    memset(&array, 0, sizeof(array));
+    MessageType type;
+    window_data_array_init(&array, WINDOW_SIZE, STRING_POOL_BYTES);
+    DecodeResult result = message_decode_departures(&array, long_strings->data, long_strings->length, &type);
+    CHECK(result == DecodeResultInvalid, "snapshot too big for the pool gave result %d", result);
+
+    result = message_decode_departures(&array, long_strings_fitted->data, long_strings_fitted->length, &type);
+    CHECK(result == DecodeResultUpdated, "fitted long strings snapshot gave result %d", result);
+    CHECK(array.data_len > 0 && array.data_len < WINDOW_SIZE && strings_present(&array),
+        "fitted long strings snapshot gave %d departures", array.data_len);
+
+    CHECK(message_decode_departures(&array, snapshot->data, snapshot->length, &type) == DecodeResultUpdated,
+        "snapshot after a fitted one not applied");
+    const size_t pool_used = array.string_pool_used;
+    result = message_decode_departures(&array, delta_long_strings->data, delta_long_strings->length, &type);
+    CHECK(result == DecodeResultNeedsSnapshot, "delta too big for the pool gave result %d", result);
+    CHECK(array.seq == 1 && array.data_len == WINDOW_SIZE && array.string_pool_used == pool_used
+        && strings_present(&array), "delta too big for the pool changed the departures");
+    window_data_array_deinit(&array);
+}
+
+// a snapshot repeating an id is refused whole, rather than leave one copy unreachable
+static void check_duplicate_ids(const Payload* duplicate_ids) {
+    WindowDataArray array;
+    memset(&array, 0, sizeof(array));
+    MessageType type;
+    window_data_array_init(&array, WINDOW_SIZE, STRING_POOL_BYTES);
+    DecodeResult result = message_decode_departures(&array, duplicate_ids->data, duplicate_ids->length, &type);
+    CHECK(result == DecodeResultInvalid, "snapshot repeating an id gave result %d", result);
+    CHECK(array.data_len == 0, "snapshot repeating an id left %d departures", array.data_len);
+    window_data_array_deinit(&array);
+}
+
+// a refresh that can't get the outbox is retried later, not written through a bad iterator
+static void check_refresh_outbox_busy(void) {
+    const int sent = stub_outbox_sent();
+    stub_outbox_set_result(APP_MSG_BUSY);
+    refresh_now();
+    stub_outbox_set_result(APP_MSG_OK);
+    CHECK(stub_outbox_sent() == sent, "refresh sent with the outbox busy");
+    CHECK(stub_timers_pending() == 1, "busy refresh left %d timers", stub_timers_pending());
+    CHECK(stub_timer_fire_next() && stub_outbox_sent() == sent + 1, "refresh wasn't retried");
+}
+
+// a page request that fails is asked for again, and doesn't hold up refreshes
+static void check_page_request_failed(void) {
+    WindowDataArray* array = &sample_data_arr;
+    const int data_index = array->data_index;
+    const int timers = stub_timers_pending();
+    array->data_index = array->data_len - 1;
+    request_page_if_near_edge();
+    CHECK(s_requested_offset >= 0, "no page requested at the end of the window");
+    const int sent = stub_outbox_sent();
+    stub_outbox_fail(APP_MSG_SEND_TIMEOUT);
+    CHECK(s_requested_offset == -1, "failed page request still outstanding");
+    CHECK(stub_timers_pending() == timers, "failed page request changed the refresh timers");
+    request_page_if_near_edge();
+    CHECK(stub_outbox_sent() == sent + 1, "failed page request wasn't asked for again");
+    s_requested_offset = -1;
+    array->data_index = data_index;
+}
+
+/*
+A page the watch asked for while scrolling leaves the refresh timer
+alone; a refresh that's due still gets scheduled when it's answered
+*/
+static void check_page_reply(const Payload* snapshot, const Payload* delta_times, const Payload* delta_page) {
+    DictionaryIterator* iter = stub_dict_create();
+    receive(iter, snapshot);
+    receive(iter, delta_times);
+    const int registered = stub_timers_registered();
+    s_requested_offset = WINDOW_SIZE / 2;
+    receive(iter, delta_page);
+    CHECK(sample_data_arr.window_offset == WINDOW_SIZE / 2, "page not applied, offset %d",
+        sample_data_arr.window_offset);
+    CHECK(s_requested_offset == -1, "answered page request still outstanding");
+    CHECK(stub_timers_registered() == registered, "page reply restarted the refresh timer");
+
+    receive(iter, snapshot);
+    receive(iter, delta_times);
+    refresh_now();
+    const int awaiting = stub_timers_registered();
+    s_requested_offset = WINDOW_SIZE / 2;
+    receive(iter, delta_page);
+    CHECK(stub_timers_registered() == awaiting + 1, "page reply with a refresh due didn't schedule the next");
+    stub_dict_destroy(iter);
+}
+
+/*
+Only a delta the watch can't apply asks the phone to resend its last
+list; the retry after an error fetches again
+*/
+static void check_needs_snapshot(const Payload* snapshot, const Payload* delta_page) {
+    DictionaryIterator* iter = stub_dict_create();
+    receive(iter, delta_page);
+    CHECK(stub_outbox_last_int(MESSAGE_KEY_seq, -1) == 0, "delta on the wrong seq didn't ask for a snapshot");
+    CHECK(stub_outbox_last_int(MESSAGE_KEY_needs_snapshot, 0) == 1, "snapshot request not marked as one");
+
+    stub_dict_clear(iter);
+    stub_dict_add_int16(iter, MESSAGE_KEY_num_routes, NO_CONNECTION);
+    inbox_received_callback(iter, NULL);
+    CHECK(stub_timer_fire_next(), "no retry after an error");
+    CHECK(stub_outbox_last_int(MESSAGE_KEY_seq, -1) == 0, "retry after an error sent seq %d",
+        (int)stub_outbox_last_int(MESSAGE_KEY_seq, -1));
+    CHECK(stub_outbox_last_int(MESSAGE_KEY_needs_snapshot, 0) == 0, "retry after an error asked for a snapshot");
+
+    receive(iter, snapshot);
+    CHECK(sample_data_arr.seq == 1, "snapshot after an error not applied, seq %d", sample_data_arr.seq);
+    stub_dict_destroy(iter);
+}
+
+/*
+Scrolling back and forth between departures of three vehicle types
+draws the current one and the ones either side, which all stay loaded
+*/
+static void check_sequence_cache(void) {
+    const VehicleType types[] = {BUS, STREETCAR, BUS, SUBWAY};
+    resource_cache_get_sequence(STREETCAR);
+    resource_cache_get_sequence(SUBWAY);
+    resource_cache_get_sequence(BUS);
+    const int loaded = stub_sequences_loaded();
+    for (int i = 0; i < 40; i += 1) {
+        CHECK(resource_cache_get_sequence(types[i % 4]) != NULL, "no sequence for vehicle type %d", types[i % 4]);
+    }
+    CHECK(stub_sequences_loaded() == loaded, "scrolling between three vehicle types loaded %d sequences",
+        stub_sequences_loaded() - loaded);
+}
+
+static void bench_navigation(int iterations) {
+    WindowDataArray* array = &sample_data_arr;
+    long steps = 0;
+    const uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        array->data_index = 0;
+        while (window_data_inc(array) == 0) {
+            steps += 1;
+        }
+        while (window_data_dec(array) == 0) {
+            steps += 1;
+        }
+    }
+    report("window_data_inc/dec", steps, now_ns() - start);
+    CHECK(steps == (long)iterations * 2 * (array->data_len - 1), "took %ld steps", steps);
+
+    long jumps = 0;
+    int visited = 0;
+    const uint64_t jump_start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        array->data_index = 0;
+        for (int j = 0; j < array->num_groups; j += 1) {
+            array->data_index += window_data_next_group_steps(array);
+            jumps += 1;
+        }
+        visited = array->data_index;
+    }
+    report("window_data_next_group_steps", jumps, now_ns() - jump_start);
+    CHECK(visited == 0, "jumping through every stop ended at %d, not back at 0", visited);
+    array->data_index = 0;
+}
+
+static void bench_layout(int iterations) {
+    WindowDataArray* array = &sample_data_arr;
+    const GRect bounds = layer_get_bounds(s_route_layer);
+    GFont font = fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD);
+    GSize number_sizes[WINDOW_SIZE];
+    GSize name_sizes[WINDOW_SIZE];
+    for (int i = 0; i < array->data_len; i += 1) {
+        number_sizes[i] = graphics_text_layout_get_content_size(array->array[i].route_number, font, bounds,
+            GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft);
+        name_sizes[i] = graphics_text_layout_get_content_size(array->array[i].route_name, font, bounds,
+            GTextOverflowModeTrailingEllipsis, GTextAlignmentRight);
+    }
+
+    long layouts = 0;
+    uint32_t sink = 0;
+    const uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        for (int j = 0; j < array->data_len; j += 1) {
+            const uint16_t pill_width = route_layout_pill_width(bounds, array->array[j].shape, number_sizes[j]);
+            const RouteLayout layout = route_layout_arrange(bounds, pill_width, number_sizes[j], name_sizes[j]);
+            sink += layout.pill_bounds.size.w + layout.name_bounds.origin.x;
+            layouts += 1;
+        }
+    }
+    report("route_layout (math only)", layouts, now_ns() - start);
+    CHECK(sink > 0, "route layouts came out empty");
+
+    const uint64_t measure_start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        for (int j = 0; j < array->data_len; j += 1) {
+            array->array[j].route_layout_valid = false;
+        }
+        measure_route_layouts(array);
+    }
+    report("measure_route_layouts (12)", iterations, now_ns() - measure_start);
+}
+
+static void keep_index(void) {
+}
+
+static void bench_scroll(int iterations) {
+    long updates = 0;
+    const uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        sample_data_arr.data_index = 0;
+        Animation* scroll = create_anim_scroll(&sample_data_arr, s_description_layer, s_vehicle_layer,
+            &s_vehicle_frame_index, 3, keep_index);
+        stub_animation_run(scroll, SCROLL_UPDATES);
+        updates += SCROLL_UPDATES;
+    }
+    report("scroll animation update", updates, now_ns() - start);
+    CHECK(!sample_data_arr.anim_intermediates.has_time && !sample_data_arr.anim_intermediates.has_color,
+        "scroll left intermediates behind");
+
+    const uint64_t render_start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        stub_layer_render(window_get_root_layer(s_window));
+    }
+    report("render window", iterations, now_ns() - render_start);
+
+    const uint64_t vehicle_start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        stub_layer_render(s_vehicle_layer);
+    }
+    report("render vehicle layer", iterations, now_ns() - vehicle_start);
+
+    const uint64_t route_start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        stub_layer_render(s_route_layer);
+    }
+    report("render route layer", iterations, now_ns() - route_start);
+}
+
+static int s_frames_drawn = 0;
+static long s_layers_drawn = 0;
+
+// before: any change marked the root, so every frame drew the whole window
+static void draw_window(void) {
+    if (stub_layer_take_dirty(window_get_root_layer(s_window))) {
+        stub_layer_render(window_get_root_layer(s_window));
+        s_frames_drawn += 1;
+    }
+}
+
+static void draw_dirty_layers(void) {
+    const int rendered = stub_layer_render_dirty(window_get_root_layer(s_window));
+    if (rendered > 0) {
+        s_frames_drawn += 1;
+        s_layers_drawn += rendered;
+    }
+}
+
+/*
+A scroll with a frame drawn after every update, drawing either the
+whole window or only the layers the update marked dirty
+*/
+static uint64_t time_scroll_frames(int iterations, StubFrameHandler draw) {
+    stub_layer_take_dirty(window_get_root_layer(s_window));
+    s_frames_drawn = 0;
+    s_layers_drawn = 0;
+    stub_animation_set_frame_handler(draw);
+    const uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i += 1) {
+        sample_data_arr.data_index = 0;
+        Animation* scroll = create_anim_scroll(&sample_data_arr, s_description_layer, s_vehicle_layer,
+            &s_vehicle_frame_index, 3, keep_index);
+        stub_animation_run(scroll, SCROLL_UPDATES);
+    }
+    const uint64_t elapsed = now_ns() - start;
+    stub_animation_set_frame_handler(NULL);
+    return elapsed;
+}
+
+static void bench_scroll_frames(int iterations) {
+    report("scroll frame, whole window", (long)iterations * SCROLL_UPDATES, time_scroll_frames(iterations, draw_window));
+    const int window_frames = s_frames_drawn;
+    report("scroll frame, dirty layers", (long)iterations * SCROLL_UPDATES,
+        time_scroll_frames(iterations, draw_dirty_layers));
+    CHECK(s_frames_drawn == window_frames, "drew %d frames from dirty layers, %d from the window",
+        s_frames_drawn, window_frames);
+    printf("layers drawn per scroll frame    %10.1f\n", (double)s_layers_drawn / (double)s_frames_drawn);
+}
+
+/*
+What the departures cost on the heap, against the layout before they
+moved into one arena: the entries in one block and five 32-byte
+blocks of strings per entry
+*/
+typedef struct {
+    int16_t time;
+    char* unit;
+    char* stop_name;
+    char* dest_name;
+    char* route_number;
+    char* route_name;
+    VehicleType vehicle_type;
+    GColor color;
+    RouteShape shape;
+} SeparateBuffersWindowData;
+
+static void report_heap(void) {
+    size_t used_before = heap_bytes_used();
+    size_t blocks_before = stub_heap_blocks();
+    SeparateBuffersWindowData* separate = malloc(WINDOW_SIZE * sizeof(SeparateBuffersWindowData));
+    for (int i = 0; i < WINDOW_SIZE; i += 1) {
+        separate[i].unit = malloc(32);
+        separate[i].stop_name = malloc(32);
+        separate[i].dest_name = malloc(32);
+        separate[i].route_number = malloc(32);
+        separate[i].route_name = malloc(32);
+    }
+    printf("heap, separate buffers           %10d B   %4d blocks\n",
+        (int)(heap_bytes_used() - used_before), (int)(stub_heap_blocks() - blocks_before));
+    for (int i = 0; i < WINDOW_SIZE; i += 1) {
+        free(separate[i].unit);
+        free(separate[i].stop_name);
+        free(separate[i].dest_name);
+        free(separate[i].route_number);
+        free(separate[i].route_name);
+    }
+    free(separate);
+
+    used_before = heap_bytes_used();
+    blocks_before = stub_heap_blocks();
+    WindowDataArray arena;
+    memset(&arena, 0, sizeof(arena));
+    window_data_array_init(&arena, WINDOW_SIZE, STRING_POOL_BYTES);
+    printf("heap, arena                      %10d B   %4d blocks\n",
+        (int)(heap_bytes_used() - used_before), (int)(stub_heap_blocks() - blocks_before));
+    window_data_array_deinit(&arena);
+}
+
+int main(void) {
+    const char* iterations_env = getenv("BENCH_ITERATIONS");
+    const int iterations = iterations_env != NULL ? atoi(iterations_env) : DEFAULT_ITERATIONS;
+    stub_log_set_enabled(getenv("BENCH_LOG") != NULL);
+
+    Payload snapshot = load_payload("snapshot.bin");
+    Payload delta_times = load_payload("delta_times.bin");
+    Payload delta_page = load_payload("delta_page.bin");
+    Payload long_strings = load_payload("snapshot_long_strings.bin");
+    Payload long_strings_fitted = load_payload("snapshot_long_strings_fitted.bin");
+    Payload delta_long_strings = load_payload("delta_long_strings.bin");
+    Payload duplicate_ids = load_payload("snapshot_duplicate_ids.bin");
+
+    printf("%d routes per window, %d iterations, %d + %d + %d payload bytes\n",
+        WINDOW_SIZE, iterations, (int)snapshot.length, (int)delta_times.length, (int)delta_page.length);
+    report_heap();
+
+    // with no room for the departures, init gives up before touching anything else
+    stub_heap_set_limit(heap_bytes_used() + 64);
+    CHECK(!init(), "init succeeded without memory for the departures");
+    CHECK(sample_data_arr.array == NULL && s_window == NULL, "failed init left state behind");
+    stub_heap_set_limit(0);
+
+    CHECK(init(), "init failed");
+    bench_inbox(iterations, &snapshot, &delta_times, &delta_page);
+    // the rest run on the first window
+    DictionaryIterator* iter = stub_dict_create();
+    receive(iter, &snapshot);
+    stub_dict_destroy(iter);
+
+    bench_decode(iterations, &snapshot);
+    check_string_pool(&snapshot, &long_strings, &long_strings_fitted, &delta_long_strings);
+    check_duplicate_ids(&duplicate_ids);
+    check_refresh_outbox_busy();
+    check_page_request_failed();
+    check_needs_snapshot(&snapshot, &delta_page);
+    check_page_reply(&snapshot, &delta_times, &delta_page);
+    check_sequence_cache();
+    bench_navigation(iterations);
+    bench_layout(iterations);
+    bench_scroll(iterations);
+    bench_scroll_frames(iterations);
+    deinit();
+
+    stub_free(snapshot.data);
+    stub_free(delta_times.data);
+    stub_free(delta_page.data);
+    stub_free(long_strings.data);
+    stub_free(long_strings_fitted.data);
+    stub_free(delta_long_strings.data);
+    stub_free(duplicate_ids.data);
+
+    if (s_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", s_failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+#include <pebble.h>
+
+/*
+Hooks into the fake SDK in pebble_stub.c that only the harness uses
+*/
+
+// the watch's app heap, roughly
+#define STUB_HEAP_SIZE 65536
+// per allocation: a header, and the size rounded up to this
+#define STUB_HEAP_BLOCK_OVERHEAD 8
+#define STUB_HEAP_ALIGN 8
+
+// 0 means the whole STUB_HEAP_SIZE
+void stub_heap_set_limit(size_t bytes);
+size_t stub_heap_blocks(void);
+
+void stub_log_set_enabled(bool enabled);
+
+// messages coming in from the phone
+DictionaryIterator* stub_dict_create(void);
+void stub_dict_destroy(DictionaryIterator* iter);
+void stub_dict_clear(DictionaryIterator* iter);
+void stub_dict_add_data(DictionaryIterator* iter, uint32_t key, const uint8_t* data, uint16_t length);
+void stub_dict_add_int16(DictionaryIterator* iter, uint32_t key, int16_t value);
+
+// messages going out to the phone
+void stub_outbox_set_result(AppMessageResult result);
+int stub_outbox_sent(void);
+// report the last message sent as failed, like the SDK does later on
+void stub_outbox_fail(AppMessageResult reason);
+// the value last written for `key` in a sent message, or `otherwise`
+int32_t stub_outbox_last_int(uint32_t key, int32_t otherwise);
+
+void stub_click(ButtonId button_id);
+
+/*
+Run an animation (and everything in it, for sequences and spawns) to
+the end synchronously with `num_updates` evenly spaced updates, then
+destroy it like the SDK does
+*/
+void stub_animation_run(Animation* animation, int num_updates);
+
+typedef void (*StubFrameHandler)(void);
+// called after every animation update, where the firmware would draw a frame
+void stub_animation_set_frame_handler(StubFrameHandler handler);
+
+// call the update procs of `layer` and everything below it
+void stub_layer_render(Layer* layer);
+/*
+Render only the layers marked dirty since the last render, with
+everything below them, returning how many were rendered
+*/
+int stub_layer_render_dirty(Layer* layer);
+// clear the dirty marks under `layer`, returning whether there were any
+bool stub_layer_take_dirty(Layer* layer);
+// how many times any layer has been marked dirty
+uint32_t stub_layer_dirty_count(void);
+const char* stub_text_layer_get_text(TextLayer* text_layer);
+
+// how many draw command sequences have been loaded from resources
+int stub_sequences_loaded(void);
+
+int stub_timers_pending(void);
+// how many timers have ever been registered, to tell one being restarted
+int stub_timers_registered(void);
+// fire the soonest pending timer, returning false if there are none
+bool stub_timer_fire_next(void);
@@ -0,0 +1,383 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#pragma once
+
+/*
+Just enough of the Pebble SDK to compile src/c on a Linux host. Types
+and constants follow the SDK; the functions are fakes implemented in
+pebble_stub.c, and host.h has the extra hooks the harness uses to feed
+messages in and drive animations.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define SECONDS_PER_MINUTE 60
+
+// logging
+
+typedef enum {
+    APP_LOG_LEVEL_ERROR = 1,
+    APP_LOG_LEVEL_WARNING = 50,
+    APP_LOG_LEVEL_INFO = 100,
+    APP_LOG_LEVEL_DEBUG = 200,
+} AppLogLevel;
+
+void app_log(uint8_t level, const char* filename, int line, const char* fmt, ...);
+#define APP_LOG(level, fmt, ...) app_log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+
+// heap, counted so heap_bytes_used() means something
+
+void* stub_malloc(size_t size);
+void* stub_calloc(size_t count, size_t size);
+void stub_free(void* ptr);
+size_t heap_bytes_used(void);
+size_t heap_bytes_free(void);
+#ifndef PEBBLE_STUB_IMPLEMENTATION
+#define malloc(size) stub_malloc(size)
+#define calloc(count, size) stub_calloc(count, size)
+#define free(ptr) stub_free(ptr)
+#endif
+
+// geometry and colour
+
+typedef union {
+    uint8_t argb;
+    struct {
+        uint8_t b:2;
+        uint8_t g:2;
+        uint8_t r:2;
+        uint8_t a:2;
+    };
+} GColor8;
+typedef GColor8 GColor;
+
+#define GColorClear ((GColor){.argb=0x00})
+#define GColorBlack ((GColor){.argb=0xC0})
+#define GColorDarkGray ((GColor){.argb=0xD5})
+#define GColorPictonBlue ((GColor){.argb=0xDB})
+#define GColorRed ((GColor){.argb=0xF0})
+#define GColorMelon ((GColor){.argb=0xFA})
+#define GColorWhite ((GColor){.argb=0xFF})
+bool gcolor_equal(GColor8 x, GColor8 y);
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+} GPoint;
+#define GPoint(x, y) ((GPoint){(x), (y)})
+#define GPointZero GPoint(0, 0)
+
+typedef struct {
+    int16_t w;
+    int16_t h;
+} GSize;
+#define GSize(w, h) ((GSize){(w), (h)})
+
+typedef struct {
+    GPoint origin;
+    GSize size;
+} GRect;
+#define GRect(x, y, w, h) ((GRect){{(x), (y)}, {(w), (h)}})
+#define GRectZero GRect(0, 0, 0, 0)
+
+typedef enum {
+    GCornerNone = 0,
+    GCornersAll = 0xf,
+} GCornerMask;
+
+typedef enum {
+    GTextOverflowModeWordWrap,
+    GTextOverflowModeTrailingEllipsis,
+    GTextOverflowModeFill,
+} GTextOverflowMode;
+
+typedef enum {
+    GTextAlignmentLeft,
+    GTextAlignmentCenter,
+    GTextAlignmentRight,
+} GTextAlignment;
+
+// fonts and text
+
+#define FONT_KEY_GOTHIC_18 "RESOURCE_ID_GOTHIC_18"
+#define FONT_KEY_GOTHIC_18_BOLD "RESOURCE_ID_GOTHIC_18_BOLD"
+#define FONT_KEY_GOTHIC_24_BOLD "RESOURCE_ID_GOTHIC_24_BOLD"
+#define FONT_KEY_LECO_42_NUMBERS "RESOURCE_ID_LECO_42_NUMBERS"
+
+typedef struct GFontStub* GFont;
+typedef struct GTextAttributes GTextAttributes;
+
+GFont fonts_get_system_font(const char* font_key);
+GSize graphics_text_layout_get_content_size(const char* text, const GFont font, const GRect box,
+    const GTextOverflowMode overflow_mode, const GTextAlignment alignment);
+GTextAttributes* graphics_text_attributes_create(void);
+void graphics_text_attributes_destroy(GTextAttributes* text_attributes);
+void graphics_text_attributes_enable_screen_text_flow(GTextAttributes* text_attributes, uint8_t inset);
+
+// layers and windows
+
+typedef struct GContext GContext;
+typedef struct Layer Layer;
+typedef struct TextLayer TextLayer;
+typedef struct Window Window;
+typedef void (*LayerUpdateProc)(Layer* layer, GContext* ctx);
+
+Layer* layer_create(GRect frame);
+void layer_destroy(Layer* layer);
+void layer_set_update_proc(Layer* layer, LayerUpdateProc update_proc);
+void layer_mark_dirty(Layer* layer);
+void layer_add_child(Layer* parent, Layer* child);
+void layer_set_hidden(Layer* layer, bool hidden);
+GRect layer_get_frame(const Layer* layer);
+GRect layer_get_bounds(const Layer* layer);
+void layer_set_bounds(Layer* layer, GRect bounds);
+
+TextLayer* text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer* text_layer);
+Layer* text_layer_get_layer(TextLayer* text_layer);
+void text_layer_set_text(TextLayer* text_layer, const char* text);
+void text_layer_set_font(TextLayer* text_layer, GFont font);
+void text_layer_set_text_alignment(TextLayer* text_layer, GTextAlignment alignment);
+void text_layer_set_text_color(TextLayer* text_layer, GColor color);
+void text_layer_set_overflow_mode(TextLayer* text_layer, GTextOverflowMode overflow_mode);
+void text_layer_enable_screen_text_flow_and_paging(TextLayer* text_layer, uint8_t inset);
+
+typedef void (*WindowHandler)(Window* window);
+typedef struct {
+    WindowHandler load;
+    WindowHandler appear;
+    WindowHandler disappear;
+    WindowHandler unload;
+} WindowHandlers;
+
+typedef void* ClickRecognizerRef;
+typedef void (*ClickHandler)(ClickRecognizerRef recognizer, void* context);
+typedef void (*ClickConfigProvider)(void* context);
+typedef enum {
+    BUTTON_ID_BACK,
+    BUTTON_ID_UP,
+    BUTTON_ID_SELECT,
+    BUTTON_ID_DOWN,
+    NUM_BUTTONS,
+} ButtonId;
+
+Window* window_create(void);
+void window_destroy(Window* window);
+Layer* window_get_root_layer(const Window* window);
+void window_set_user_data(Window* window, void* data);
+void* window_get_user_data(const Window* window);
+void window_set_window_handlers(Window* window, WindowHandlers handlers);
+void window_set_click_config_provider(Window* window, ClickConfigProvider click_config_provider);
+void window_stack_push(Window* window, bool animated);
+void window_single_click_subscribe(ButtonId button_id, ClickHandler handler);
+
+// drawing
+
+typedef struct GDrawCommandSequence GDrawCommandSequence;
+typedef struct GDrawCommandFrame GDrawCommandFrame;
+typedef struct GDrawCommandImage GDrawCommandImage;
+
+void graphics_context_set_fill_color(GContext* ctx, GColor color);
+void graphics_context_set_stroke_color(GContext* ctx, GColor color);
+void graphics_context_set_text_color(GContext* ctx, GColor color);
+void graphics_context_set_stroke_width(GContext* ctx, uint8_t stroke_width);
+void graphics_fill_rect(GContext* ctx, GRect rect, uint16_t corner_radius, GCornerMask corner_mask);
+void graphics_draw_line(GContext* ctx, GPoint p0, GPoint p1);
+void graphics_draw_text(GContext* ctx, const char* text, const GFont font, const GRect box,
+    const GTextOverflowMode overflow_mode, const GTextAlignment alignment, GTextAttributes* text_attributes);
+
+GDrawCommandSequence* gdraw_command_sequence_create_with_resource(uint32_t resource_id);
+void gdraw_command_sequence_destroy(GDrawCommandSequence* sequence);
+uint32_t gdraw_command_sequence_get_num_frames(GDrawCommandSequence* sequence);
+GSize gdraw_command_sequence_get_bounds_size(GDrawCommandSequence* sequence);
+GDrawCommandFrame* gdraw_command_sequence_get_frame_by_index(GDrawCommandSequence* sequence, uint32_t index);
+void gdraw_command_frame_draw(GContext* ctx, GDrawCommandSequence* sequence, GDrawCommandFrame* frame, GPoint offset);
+GDrawCommandImage* gdraw_command_image_create_with_resource(uint32_t resource_id);
+void gdraw_command_image_destroy(GDrawCommandImage* image);
+void gdraw_command_image_draw(GContext* ctx, GDrawCommandImage* image, GPoint offset);
+
+enum {
+    RESOURCE_ID_PLANE = 1,
+    RESOURCE_ID_GENERIC_FAILED,
+    RESOURCE_ID_NO_INTERNET,
+    RESOURCE_ID_STREETCAR_ANIM,
+    RESOURCE_ID_SUBWAY_ANIM,
+    RESOURCE_ID_BUS_ANIM,
+    RESOURCE_ID_TRAIN_ANIM,
+};
+
+// animations
+
+typedef struct Animation Animation;
+typedef struct PropertyAnimation PropertyAnimation;
+typedef int32_t AnimationProgress;
+#define ANIMATION_NORMALIZED_MAX 65535
+
+typedef enum {
+    AnimationCurveLinear,
+    AnimationCurveEaseIn,
+    AnimationCurveEaseOut,
+    AnimationCurveEaseInOut,
+} AnimationCurve;
+
+typedef void (*AnimationStartedHandler)(Animation* animation, void* context);
+typedef void (*AnimationStoppedHandler)(Animation* animation, bool finished, void* context);
+typedef struct {
+    AnimationStartedHandler started;
+    AnimationStoppedHandler stopped;
+} AnimationHandlers;
+
+typedef void (*AnimationSetupImplementation)(Animation* animation);
+typedef void (*AnimationUpdateImplementation)(Animation* animation, const AnimationProgress progress);
+typedef void (*AnimationTeardownImplementation)(Animation* animation);
+typedef struct {
+    AnimationSetupImplementation setup;
+    AnimationUpdateImplementation update;
+    AnimationTeardownImplementation teardown;
+} AnimationImplementation;
+
+typedef void (*Int16Setter)(void* subject, int16_t int16);
+typedef int16_t (*Int16Getter)(void* subject);
+typedef struct {
+    AnimationImplementation base;
+    struct {
+        union {
+            Int16Setter int16;
+        } setter;
+        union {
+            Int16Getter int16;
+        } getter;
+    } accessors;
+} PropertyAnimationImplementation;
+
+Animation* animation_create(void);
+bool animation_destroy(Animation* animation);
+bool animation_set_implementation(Animation* animation, const AnimationImplementation* implementation);
+bool animation_set_handlers(Animation* animation, AnimationHandlers callbacks, void* context);
+void* animation_get_context(Animation* animation);
+bool animation_set_duration(Animation* animation, uint32_t duration_ms);
+bool animation_set_delay(Animation* animation, uint32_t delay_ms);
+bool animation_set_curve(Animation* animation, AnimationCurve curve);
+bool animation_schedule(Animation* animation);
+bool animation_unschedule(Animation* animation);
+bool animation_is_scheduled(Animation* animation);
+Animation* animation_sequence_create(Animation* animation_a, Animation* animation_b, ...);
+Animation* animation_spawn_create(Animation* animation_a, Animation* animation_b, ...);
+
+PropertyAnimation* property_animation_create(const PropertyAnimationImplementation* implementation,
+    void* subject, void* from_value, void* to_value);
+PropertyAnimation* property_animation_create_bounds_origin(Layer* layer, GPoint* from, GPoint* to);
+Animation* property_animation_get_animation(PropertyAnimation* property_animation);
+bool property_animation_get_subject(PropertyAnimation* property_animation, void** subject);
+bool property_animation_from(PropertyAnimation* property_animation, void* from, size_t size, bool set);
+bool property_animation_to(PropertyAnimation* property_animation, void* to, size_t size, bool set);
+void property_animation_update_int16(PropertyAnimation* property_animation, const uint32_t distance_normalized);
+
+// AppMessage
+
+typedef enum {
+    APP_MSG_OK = 0,
+    APP_MSG_SEND_TIMEOUT = 1 << 1,
+    APP_MSG_SEND_REJECTED = 1 << 2,
+    APP_MSG_NOT_CONNECTED = 1 << 3,
+    APP_MSG_BUSY = 1 << 6,
+    APP_MSG_OUT_OF_MEMORY = 1 << 8,
+} AppMessageResult;
+
+typedef enum {
+    TUPLE_BYTE_ARRAY = 0,
+    TUPLE_CSTRING = 1,
+    TUPLE_UINT = 2,
+    TUPLE_INT = 3,
+} TupleType;
+
+typedef union {
+    uint8_t data[4];
+    char cstring[4];
+    int8_t int8;
+    int16_t int16;
+    int32_t int32;
+    uint32_t uint32;
+} TupleValue;
+
+typedef struct {
+    uint32_t key;
+    TupleType type;
+    uint16_t length;
+    TupleValue* value;
+} Tuple;
+
+typedef struct DictionaryIterator DictionaryIterator;
+typedef void (*AppMessageInboxReceived)(DictionaryIterator* iterator, void* context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator* iterator, AppMessageResult reason, void* context);
+
+extern const uint32_t MESSAGE_KEY_num_routes;
+extern const uint32_t MESSAGE_KEY_departures;
+extern const uint32_t MESSAGE_KEY_seq;
+extern const uint32_t MESSAGE_KEY_page_offset;
+extern const uint32_t MESSAGE_KEY_needs_snapshot;
+
+Tuple* dict_find(const DictionaryIterator* iter, const uint32_t key);
+int dict_write_int32(DictionaryIterator* iter, const uint32_t key, const int32_t value);
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+uint32_t app_message_inbox_size_maximum(void);
+void app_message_register_inbox_received(AppMessageInboxReceived received_callback);
+void app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+AppMessageResult app_message_outbox_begin(DictionaryIterator** iterator);
+AppMessageResult app_message_outbox_send(void);
+
+// services
+
+typedef enum {
+    SECOND_UNIT = 1 << 0,
+    MINUTE_UNIT = 1 << 1,
+} TimeUnits;
+typedef void (*TickHandler)(struct tm* tick_time, TimeUnits units_changed);
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+void tick_timer_service_unsubscribe(void);
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void* data);
+AppTimer* app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void* callback_data);
+void app_timer_cancel(AppTimer* timer_handle);
+
+typedef struct {
+    uint8_t charge_percent;
+    bool is_charging;
+    bool is_plugged;
+} BatteryChargeState;
+BatteryChargeState battery_state_service_peek(void);
+
+typedef void (*ConnectionHandler)(bool connected);
+typedef struct {
+    ConnectionHandler pebble_app_connection_handler;
+    ConnectionHandler pebblekit_connection_handler;
+} ConnectionHandlers;
+bool connection_service_peek_pebble_app_connection(void);
+void connection_service_subscribe(ConnectionHandlers conn_handlers);
+void connection_service_unsubscribe(void);
+
+void vibes_short_pulse(void);
+void app_event_loop(void);
+
+// persistent storage
+
+#define PERSIST_DATA_MAX_LENGTH 256
+bool persist_exists(const uint32_t key);
+int32_t persist_read_int(const uint32_t key);
+int persist_read_data(const uint32_t key, void* buffer, const size_t buffer_size);
+int persist_write_int(const uint32_t key, const int32_t value);
+int persist_write_data(const uint32_t key, const void* data, const size_t size);
+int persist_delete(const uint32_t key);
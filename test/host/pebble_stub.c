@@ -0,0 +1,1091 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+#define PEBBLE_STUB_IMPLEMENTATION
+#include <stdarg.h>
+#include "pebble.h"
+#include "host.h"
+
+/*
+Fakes for the parts of the SDK src/c uses. They do the least that keeps
+the app's own logic honest: the heap is counted, text is measured with
+a fixed advance per character, drawing does nothing, and animations
+only run when the harness asks.
+*/
+
+// logging
+
+static bool s_log_enabled = false;
+
+void stub_log_set_enabled(bool enabled) {
+    s_log_enabled = enabled;
+}
+
+void app_log(uint8_t level, const char* filename, int line, const char* fmt, ...) {
+    if (!s_log_enabled) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "[%d] %s:%d ", level, filename, line);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+// heap
+
+typedef struct {
+    size_t cost;
+    // keeps the memory after the header aligned for anything
+    max_align_t align;
+} BlockHeader;
+
+static size_t s_heap_used = 0;
+static size_t s_heap_blocks = 0;
+static size_t s_heap_limit = 0;
+
+static size_t block_cost(size_t size) {
+    return (size + STUB_HEAP_ALIGN - 1) / STUB_HEAP_ALIGN * STUB_HEAP_ALIGN + STUB_HEAP_BLOCK_OVERHEAD;
+}
+
+static size_t heap_limit(void) {
+    return s_heap_limit != 0 ? s_heap_limit : STUB_HEAP_SIZE;
+}
+
+void* stub_malloc(size_t size) {
+    const size_t cost = block_cost(size);
+    if (s_heap_used + cost > heap_limit()) {
+        return NULL;
+    }
+    BlockHeader* header = malloc(sizeof(BlockHeader) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->cost = cost;
+    s_heap_used += cost;
+    s_heap_blocks += 1;
+    return header + 1;
+}
+
+void* stub_calloc(size_t count, size_t size) {
+    void* result = stub_malloc(count * size);
+    if (result != NULL) {
+        memset(result, 0, count * size);
+    }
+    return result;
+}
+
+void stub_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    BlockHeader* header = (BlockHeader*)ptr - 1;
+    s_heap_used -= header->cost;
+    s_heap_blocks -= 1;
+    free(header);
+}
+
+size_t heap_bytes_used(void) {
+    return s_heap_used;
+}
+
+size_t heap_bytes_free(void) {
+    return heap_limit() > s_heap_used ? heap_limit() - s_heap_used : 0;
+}
+
+void stub_heap_set_limit(size_t bytes) {
+    s_heap_limit = bytes;
+}
+
+size_t stub_heap_blocks(void) {
+    return s_heap_blocks;
+}
+
+bool gcolor_equal(GColor8 x, GColor8 y) {
+    return x.argb == y.argb;
+}
+
+// fonts and text
+
+struct GFontStub {
+    const char* key;
+    int16_t size;
+};
+
+static struct GFontStub s_fonts[8];
+
+GFont fonts_get_system_font(const char* font_key) {
+    for (size_t i = 0; i < sizeof(s_fonts) / sizeof(s_fonts[0]); i += 1) {
+        if (s_fonts[i].key == NULL) {
+            // the point size is the first number in the key
+            const char* digits = font_key;
+            while (*digits != 0 && (*digits < '0' || *digits > '9')) {
+                digits += 1;
+            }
+            s_fonts[i] = (struct GFontStub) {
+                .key = font_key,
+                .size = *digits != 0 ? (int16_t)atoi(digits) : 14,
+            };
+        }
+        if (strcmp(s_fonts[i].key, font_key) == 0) {
+            return &s_fonts[i];
+        }
+    }
+    return &s_fonts[0];
+}
+
+/*
+Every character advances half the point size and lines are 1.2 times
+it, wrapping at the box width: close enough to Gothic for layouts to
+come out the right shape
+*/
+GSize graphics_text_layout_get_content_size(const char* text, const GFont font, const GRect box,
+        const GTextOverflowMode overflow_mode, const GTextAlignment alignment) {
+    const int16_t size = font != NULL ? font->size : 14;
+    const int advance = size / 2;
+    const int line_height = size * 6 / 5;
+    int width = 0;
+    for (const char* c = text; *c != 0; c += 1) {
+        // count characters rather than UTF-8 continuation bytes
+        if (((uint8_t)*c & 0xc0) != 0x80) {
+            width += advance;
+        }
+    }
+    int lines = width > 0 ? 1 : 0;
+    if (box.size.w > 0 && width > box.size.w) {
+        if (overflow_mode == GTextOverflowModeWordWrap) {
+            lines = (width + box.size.w - 1) / box.size.w;
+        }
+        width = box.size.w;
+    }
+    int height = lines * line_height;
+    if (box.size.h > 0 && height > box.size.h) {
+        height = box.size.h;
+    }
+    return GSize(width, height);
+}
+
+struct GTextAttributes {
+    uint8_t inset;
+};
+
+GTextAttributes* graphics_text_attributes_create(void) {
+    return stub_calloc(1, sizeof(GTextAttributes));
+}
+
+void graphics_text_attributes_destroy(GTextAttributes* text_attributes) {
+    stub_free(text_attributes);
+}
+
+void graphics_text_attributes_enable_screen_text_flow(GTextAttributes* text_attributes, uint8_t inset) {
+    text_attributes->inset = inset;
+}
+
+// layers
+
+struct Layer {
+    GRect frame;
+    GRect bounds;
+    bool hidden;
+    bool dirty;
+    LayerUpdateProc update_proc;
+    Layer* first_child;
+    Layer* next_sibling;
+};
+
+struct TextLayer {
+    Layer layer;
+    const char* text;
+    GFont font;
+    GColor text_color;
+    GTextAlignment alignment;
+    GTextOverflowMode overflow_mode;
+};
+
+struct GContext {
+    GColor fill_color;
+    GColor stroke_color;
+    GColor text_color;
+};
+
+static uint32_t s_dirty_count = 0;
+static GContext s_context;
+
+static void layer_init(Layer* layer, GRect frame) {
+    *layer = (Layer) {
+        .frame = frame,
+        .bounds = GRect(0, 0, frame.size.w, frame.size.h),
+    };
+}
+
+Layer* layer_create(GRect frame) {
+    Layer* layer = stub_malloc(sizeof(Layer));
+    if (layer != NULL) {
+        layer_init(layer, frame);
+    }
+    return layer;
+}
+
+void layer_destroy(Layer* layer) {
+    stub_free(layer);
+}
+
+void layer_set_update_proc(Layer* layer, LayerUpdateProc update_proc) {
+    layer->update_proc = update_proc;
+}
+
+void layer_mark_dirty(Layer* layer) {
+    layer->dirty = true;
+    s_dirty_count += 1;
+}
+
+void layer_add_child(Layer* parent, Layer* child) {
+    Layer** link = &parent->first_child;
+    while (*link != NULL) {
+        link = &(*link)->next_sibling;
+    }
+    *link = child;
+    child->next_sibling = NULL;
+}
+
+void layer_set_hidden(Layer* layer, bool hidden) {
+    layer->hidden = hidden;
+}
+
+GRect layer_get_frame(const Layer* layer) {
+    return layer->frame;
+}
+
+GRect layer_get_bounds(const Layer* layer) {
+    return layer->bounds;
+}
+
+// like the firmware, moving the bounds marks the layer dirty
+void layer_set_bounds(Layer* layer, GRect bounds) {
+    layer->bounds = bounds;
+    layer_mark_dirty(layer);
+}
+
+void stub_layer_render(Layer* layer) {
+    if (layer == NULL || layer->hidden) {
+        return;
+    }
+    if (layer->update_proc != NULL) {
+        layer->update_proc(layer, &s_context);
+    }
+    for (Layer* child = layer->first_child; child != NULL; child = child->next_sibling) {
+        stub_layer_render(child);
+    }
+}
+
+bool stub_layer_take_dirty(Layer* layer) {
+    bool dirty = false;
+    for (Layer* child = layer->first_child; child != NULL; child = child->next_sibling) {
+        dirty = stub_layer_take_dirty(child) || dirty;
+    }
+    dirty = dirty || layer->dirty;
+    layer->dirty = false;
+    return dirty;
+}
+
+int stub_layer_render_dirty(Layer* layer) {
+    if (layer->hidden || layer->dirty) {
+        stub_layer_take_dirty(layer);
+        stub_layer_render(layer);
+        return layer->hidden ? 0 : 1;
+    }
+    int rendered = 0;
+    for (Layer* child = layer->first_child; child != NULL; child = child->next_sibling) {
+        rendered += stub_layer_render_dirty(child);
+    }
+    return rendered;
+}
+
+uint32_t stub_layer_dirty_count(void) {
+    return s_dirty_count;
+}
+
+TextLayer* text_layer_create(GRect frame) {
+    TextLayer* text_layer = stub_calloc(1, sizeof(TextLayer));
+    if (text_layer != NULL) {
+        layer_init(&text_layer->layer, frame);
+        text_layer->text = "";
+        text_layer->font = fonts_get_system_font("RESOURCE_ID_GOTHIC_14");
+    }
+    return text_layer;
+}
+
+void text_layer_destroy(TextLayer* text_layer) {
+    stub_free(text_layer);
+}
+
+Layer* text_layer_get_layer(TextLayer* text_layer) {
+    return &text_layer->layer;
+}
+
+void text_layer_set_text(TextLayer* text_layer, const char* text) {
+    text_layer->text = text;
+    layer_mark_dirty(&text_layer->layer);
+}
+
+const char* stub_text_layer_get_text(TextLayer* text_layer) {
+    return text_layer->text;
+}
+
+void text_layer_set_font(TextLayer* text_layer, GFont font) {
+    text_layer->font = font;
+}
+
+void text_layer_set_text_alignment(TextLayer* text_layer, GTextAlignment alignment) {
+    text_layer->alignment = alignment;
+}
+
+void text_layer_set_text_color(TextLayer* text_layer, GColor color) {
+    text_layer->text_color = color;
+}
+
+void text_layer_set_overflow_mode(TextLayer* text_layer, GTextOverflowMode overflow_mode) {
+    text_layer->overflow_mode = overflow_mode;
+}
+
+void text_layer_enable_screen_text_flow_and_paging(TextLayer* text_layer, uint8_t inset) {
+}
+
+// windows and buttons
+
+struct Window {
+    Layer root;
+    void* user_data;
+    WindowHandlers handlers;
+    ClickConfigProvider click_config_provider;
+};
+
+static ClickHandler s_click_handlers[NUM_BUTTONS];
+
+Window* window_create(void) {
+    Window* window = stub_calloc(1, sizeof(Window));
+    if (window != NULL) {
+        // chalk, the round watch
+        layer_init(&window->root, GRect(0, 0, 180, 180));
+    }
+    return window;
+}
+
+void window_destroy(Window* window) {
+    if (window->handlers.unload != NULL) {
+        window->handlers.unload(window);
+    }
+    stub_free(window);
+}
+
+Layer* window_get_root_layer(const Window* window) {
+    return (Layer*)&window->root;
+}
+
+void window_set_user_data(Window* window, void* data) {
+    window->user_data = data;
+}
+
+void* window_get_user_data(const Window* window) {
+    return window->user_data;
+}
+
+void window_set_window_handlers(Window* window, WindowHandlers handlers) {
+    window->handlers = handlers;
+}
+
+void window_set_click_config_provider(Window* window, ClickConfigProvider click_config_provider) {
+    window->click_config_provider = click_config_provider;
+}
+
+void window_stack_push(Window* window, bool animated) {
+    if (window->click_config_provider != NULL) {
+        window->click_config_provider(NULL);
+    }
+    if (window->handlers.load != NULL) {
+        window->handlers.load(window);
+    }
+    if (window->handlers.appear != NULL) {
+        window->handlers.appear(window);
+    }
+}
+
+void window_single_click_subscribe(ButtonId button_id, ClickHandler handler) {
+    s_click_handlers[button_id] = handler;
+}
+
+void stub_click(ButtonId button_id) {
+    if (s_click_handlers[button_id] != NULL) {
+        s_click_handlers[button_id](NULL, NULL);
+    }
+}
+
+// drawing
+
+void graphics_context_set_fill_color(GContext* ctx, GColor color) {
+    ctx->fill_color = color;
+}
+
+void graphics_context_set_stroke_color(GContext* ctx, GColor color) {
+    ctx->stroke_color = color;
+}
+
+void graphics_context_set_text_color(GContext* ctx, GColor color) {
+    ctx->text_color = color;
+}
+
+void graphics_context_set_stroke_width(GContext* ctx, uint8_t stroke_width) {
+}
+
+void graphics_fill_rect(GContext* ctx, GRect rect, uint16_t corner_radius, GCornerMask corner_mask) {
+}
+
+void graphics_draw_line(GContext* ctx, GPoint p0, GPoint p1) {
+}
+
+void graphics_draw_text(GContext* ctx, const char* text, const GFont font, const GRect box,
+        const GTextOverflowMode overflow_mode, const GTextAlignment alignment, GTextAttributes* text_attributes) {
+}
+
+/*
+Vehicle sequences all have 10 frames of 50x50, like the ones in
+resources/
+*/
+#define SEQUENCE_FRAMES 10
+
+struct GDrawCommandFrame {
+    uint32_t index;
+};
+
+struct GDrawCommandSequence {
+    uint32_t resource_id;
+    GDrawCommandFrame frames[SEQUENCE_FRAMES];
+};
+
+struct GDrawCommandImage {
+    uint32_t resource_id;
+};
+
+static int s_sequences_loaded = 0;
+
+GDrawCommandSequence* gdraw_command_sequence_create_with_resource(uint32_t resource_id) {
+    GDrawCommandSequence* sequence = stub_malloc(sizeof(GDrawCommandSequence));
+    if (sequence != NULL) {
+        s_sequences_loaded += 1;
+        sequence->resource_id = resource_id;
+        for (uint32_t i = 0; i < SEQUENCE_FRAMES; i += 1) {
+            sequence->frames[i].index = i;
+        }
+    }
+    return sequence;
+}
+
+void gdraw_command_sequence_destroy(GDrawCommandSequence* sequence) {
+    stub_free(sequence);
+}
+
+int stub_sequences_loaded(void) {
+    return s_sequences_loaded;
+}
+
+uint32_t gdraw_command_sequence_get_num_frames(GDrawCommandSequence* sequence) {
+    return SEQUENCE_FRAMES;
+}
+
+GSize gdraw_command_sequence_get_bounds_size(GDrawCommandSequence* sequence) {
+    return GSize(50, 50);
+}
+
+GDrawCommandFrame* gdraw_command_sequence_get_frame_by_index(GDrawCommandSequence* sequence, uint32_t index) {
+    return index < SEQUENCE_FRAMES ? &sequence->frames[index] : NULL;
+}
+
+void gdraw_command_frame_draw(GContext* ctx, GDrawCommandSequence* sequence, GDrawCommandFrame* frame, GPoint offset) {
+}
+
+GDrawCommandImage* gdraw_command_image_create_with_resource(uint32_t resource_id) {
+    GDrawCommandImage* image = stub_malloc(sizeof(GDrawCommandImage));
+    if (image != NULL) {
+        image->resource_id = resource_id;
+    }
+    return image;
+}
+
+void gdraw_command_image_destroy(GDrawCommandImage* image) {
+    stub_free(image);
+}
+
+void gdraw_command_image_draw(GContext* ctx, GDrawCommandImage* image, GPoint offset) {
+}
+
+// animations
+
+#define MAX_CHILD_ANIMATIONS 4
+
+struct Animation {
+    const AnimationImplementation* implementation;
+    AnimationHandlers handlers;
+    void* context;
+    uint32_t duration_ms;
+    uint32_t delay_ms;
+    AnimationCurve curve;
+    bool scheduled;
+    Animation* children[MAX_CHILD_ANIMATIONS];
+    int num_children;
+};
+
+/*
+The Animation comes first so a PropertyAnimation* can be passed where
+an Animation* is expected, as the SDK allows
+*/
+struct PropertyAnimation {
+    Animation animation;
+    const PropertyAnimationImplementation* property_implementation;
+    void* subject;
+    union {
+        int16_t int16;
+        GPoint gpoint;
+    } from, to;
+};
+
+Animation* animation_create(void) {
+    Animation* animation = stub_calloc(1, sizeof(Animation));
+    if (animation != NULL) {
+        animation->duration_ms = 250;
+    }
+    return animation;
+}
+
+bool animation_destroy(Animation* animation) {
+    if (animation == NULL) {
+        return false;
+    }
+    for (int i = 0; i < animation->num_children; i += 1) {
+        animation_destroy(animation->children[i]);
+    }
+    stub_free(animation);
+    return true;
+}
+
+bool animation_set_implementation(Animation* animation, const AnimationImplementation* implementation) {
+    animation->implementation = implementation;
+    return true;
+}
+
+bool animation_set_handlers(Animation* animation, AnimationHandlers callbacks, void* context) {
+    animation->handlers = callbacks;
+    animation->context = context;
+    return true;
+}
+
+void* animation_get_context(Animation* animation) {
+    return animation->context;
+}
+
+bool animation_set_duration(Animation* animation, uint32_t duration_ms) {
+    animation->duration_ms = duration_ms;
+    return true;
+}
+
+bool animation_set_delay(Animation* animation, uint32_t delay_ms) {
+    animation->delay_ms = delay_ms;
+    return true;
+}
+
+bool animation_set_curve(Animation* animation, AnimationCurve curve) {
+    animation->curve = curve;
+    return true;
+}
+
+bool animation_schedule(Animation* animation) {
+    animation->scheduled = true;
+    return true;
+}
+
+bool animation_unschedule(Animation* animation) {
+    if (!animation->scheduled) {
+        return false;
+    }
+    animation->scheduled = false;
+    if (animation->handlers.stopped != NULL) {
+        animation->handlers.stopped(animation, false, animation->context);
+    }
+    return true;
+}
+
+bool animation_is_scheduled(Animation* animation) {
+    return animation->scheduled;
+}
+
+static Animation* create_complex(Animation* animation_a, Animation* animation_b, va_list rest) {
+    Animation* animation = animation_create();
+    if (animation == NULL) {
+        return NULL;
+    }
+    Animation* child = animation_a;
+    while (child != NULL && animation->num_children < MAX_CHILD_ANIMATIONS) {
+        animation->children[animation->num_children] = child;
+        animation->num_children += 1;
+        child = animation->num_children == 1 ? animation_b : va_arg(rest, Animation*);
+    }
+    return animation;
+}
+
+Animation* animation_sequence_create(Animation* animation_a, Animation* animation_b, ...) {
+    va_list rest;
+    va_start(rest, animation_b);
+    Animation* animation = create_complex(animation_a, animation_b, rest);
+    va_end(rest);
+    return animation;
+}
+
+// spawns run their parts one after another here, which is all the harness needs
+Animation* animation_spawn_create(Animation* animation_a, Animation* animation_b, ...) {
+    va_list rest;
+    va_start(rest, animation_b);
+    Animation* animation = create_complex(animation_a, animation_b, rest);
+    va_end(rest);
+    return animation;
+}
+
+static StubFrameHandler s_frame_handler = NULL;
+
+void stub_animation_set_frame_handler(StubFrameHandler handler) {
+    s_frame_handler = handler;
+}
+
+static void run_animation(Animation* animation, int num_updates) {
+    if (animation->handlers.started != NULL) {
+        animation->handlers.started(animation, animation->context);
+    }
+    for (int i = 0; i < animation->num_children; i += 1) {
+        run_animation(animation->children[i], num_updates);
+    }
+    const AnimationImplementation* implementation = animation->implementation;
+    if (implementation != NULL) {
+        if (implementation->setup != NULL) {
+            implementation->setup(animation);
+        }
+        for (int i = 1; implementation->update != NULL && i <= num_updates; i += 1) {
+            implementation->update(animation, (AnimationProgress)((int64_t)ANIMATION_NORMALIZED_MAX * i / num_updates));
+            if (s_frame_handler != NULL) {
+                s_frame_handler();
+            }
+        }
+        if (implementation->teardown != NULL) {
+            implementation->teardown(animation);
+        }
+    }
+    animation->scheduled = false;
+    if (animation->handlers.stopped != NULL) {
+        animation->handlers.stopped(animation, true, animation->context);
+    }
+}
+
+void stub_animation_run(Animation* animation, int num_updates) {
+    run_animation(animation, num_updates > 0 ? num_updates : 1);
+    animation_destroy(animation);
+}
+
+PropertyAnimation* property_animation_create(const PropertyAnimationImplementation* implementation,
+        void* subject, void* from_value, void* to_value) {
+    PropertyAnimation* property_animation = stub_calloc(1, sizeof(PropertyAnimation));
+    if (property_animation == NULL) {
+        return NULL;
+    }
+    property_animation->animation.duration_ms = 250;
+    property_animation->animation.implementation = &implementation->base;
+    property_animation->property_implementation = implementation;
+    property_animation->subject = subject;
+    return property_animation;
+}
+
+static void update_bounds_origin(Animation* animation, const AnimationProgress progress) {
+    PropertyAnimation* property_animation = (PropertyAnimation*)animation;
+    Layer* layer = property_animation->subject;
+    const GPoint from = property_animation->from.gpoint;
+    const GPoint to = property_animation->to.gpoint;
+    layer->bounds.origin = GPoint(
+        from.x + (to.x - from.x) * progress / ANIMATION_NORMALIZED_MAX,
+        from.y + (to.y - from.y) * progress / ANIMATION_NORMALIZED_MAX);
+    layer_mark_dirty(layer);
+}
+
+static const PropertyAnimationImplementation s_bounds_origin_impl = {
+    .base = {
+        .update = update_bounds_origin,
+    },
+};
+
+PropertyAnimation* property_animation_create_bounds_origin(Layer* layer, GPoint* from, GPoint* to) {
+    PropertyAnimation* property_animation = property_animation_create(&s_bounds_origin_impl, layer, NULL, NULL);
+    if (property_animation != NULL) {
+        property_animation->from.gpoint = from != NULL ? *from : layer->bounds.origin;
+        property_animation->to.gpoint = to != NULL ? *to : layer->bounds.origin;
+    }
+    return property_animation;
+}
+
+Animation* property_animation_get_animation(PropertyAnimation* property_animation) {
+    return &property_animation->animation;
+}
+
+bool property_animation_get_subject(PropertyAnimation* property_animation, void** subject) {
+    *subject = property_animation->subject;
+    return true;
+}
+
+bool property_animation_from(PropertyAnimation* property_animation, void* from, size_t size, bool set) {
+    if (size > sizeof(property_animation->from)) {
+        return false;
+    }
+    if (set) {
+        memcpy(&property_animation->from, from, size);
+    } else {
+        memcpy(from, &property_animation->from, size);
+    }
+    return true;
+}
+
+bool property_animation_to(PropertyAnimation* property_animation, void* to, size_t size, bool set) {
+    if (size > sizeof(property_animation->to)) {
+        return false;
+    }
+    if (set) {
+        memcpy(&property_animation->to, to, size);
+    } else {
+        memcpy(to, &property_animation->to, size);
+    }
+    return true;
+}
+
+void property_animation_update_int16(PropertyAnimation* property_animation, const uint32_t distance_normalized) {
+    const int16_t from = property_animation->from.int16;
+    const int16_t to = property_animation->to.int16;
+    const int16_t value = from + (int32_t)(to - from) * (int32_t)distance_normalized / ANIMATION_NORMALIZED_MAX;
+    property_animation->property_implementation->accessors.setter.int16(property_animation->subject, value);
+}
+
+// AppMessage
+
+#define MAX_TUPLES 4
+
+struct DictionaryIterator {
+    Tuple tuples[MAX_TUPLES];
+    uint8_t* buffers[MAX_TUPLES];
+    int num_tuples;
+};
+
+const uint32_t MESSAGE_KEY_num_routes = 10000;
+const uint32_t MESSAGE_KEY_departures = 10001;
+const uint32_t MESSAGE_KEY_seq = 10002;
+const uint32_t MESSAGE_KEY_page_offset = 10003;
+const uint32_t MESSAGE_KEY_needs_snapshot = 10004;
+
+static DictionaryIterator s_outbox;
+static bool s_outbox_open = false;
+static AppMessageResult s_outbox_result = APP_MSG_OK;
+static int s_outbox_sent = 0;
+static int32_t s_sent_keys[MAX_TUPLES];
+static int32_t s_sent_values[MAX_TUPLES];
+static int s_num_sent_values = 0;
+static AppMessageOutboxFailed s_outbox_failed = NULL;
+
+DictionaryIterator* stub_dict_create(void) {
+    return calloc(1, sizeof(DictionaryIterator));
+}
+
+void stub_dict_clear(DictionaryIterator* iter) {
+    for (int i = 0; i < iter->num_tuples; i += 1) {
+        free(iter->buffers[i]);
+        iter->buffers[i] = NULL;
+    }
+    iter->num_tuples = 0;
+}
+
+void stub_dict_destroy(DictionaryIterator* iter) {
+    stub_dict_clear(iter);
+    free(iter);
+}
+
+static void dict_add(DictionaryIterator* iter, uint32_t key, TupleType type, const void* data, uint16_t length) {
+    if (iter->num_tuples >= MAX_TUPLES) {
+        return;
+    }
+    // at least a TupleValue, so small integers can be read through any member
+    uint8_t* buffer = calloc(1, length > sizeof(TupleValue) ? length : sizeof(TupleValue));
+    memcpy(buffer, data, length);
+    iter->buffers[iter->num_tuples] = buffer;
+    iter->tuples[iter->num_tuples] = (Tuple) {
+        .key = key,
+        .type = type,
+        .length = length,
+        .value = (TupleValue*)buffer,
+    };
+    iter->num_tuples += 1;
+}
+
+void stub_dict_add_data(DictionaryIterator* iter, uint32_t key, const uint8_t* data, uint16_t length) {
+    dict_add(iter, key, TUPLE_BYTE_ARRAY, data, length);
+}
+
+void stub_dict_add_int16(DictionaryIterator* iter, uint32_t key, int16_t value) {
+    dict_add(iter, key, TUPLE_INT, &value, sizeof(value));
+}
+
+Tuple* dict_find(const DictionaryIterator* iter, const uint32_t key) {
+    for (int i = 0; i < iter->num_tuples; i += 1) {
+        if (iter->tuples[i].key == key) {
+            return (Tuple*)&iter->tuples[i];
+        }
+    }
+    return NULL;
+}
+
+int dict_write_int32(DictionaryIterator* iter, const uint32_t key, const int32_t value) {
+    dict_add(iter, key, TUPLE_INT, &value, sizeof(value));
+    return 0;
+}
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+    return APP_MSG_OK;
+}
+
+uint32_t app_message_inbox_size_maximum(void) {
+    return 8200;
+}
+
+void app_message_register_inbox_received(AppMessageInboxReceived received_callback) {
+}
+
+void app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback) {
+    s_outbox_failed = failed_callback;
+}
+
+void stub_outbox_set_result(AppMessageResult result) {
+    s_outbox_result = result;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator** iterator) {
+    if (s_outbox_result != APP_MSG_OK) {
+        return s_outbox_result;
+    }
+    if (s_outbox_open) {
+        return APP_MSG_BUSY;
+    }
+    stub_dict_clear(&s_outbox);
+    s_outbox_open = true;
+    *iterator = &s_outbox;
+    return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+    if (!s_outbox_open) {
+        return APP_MSG_SEND_REJECTED;
+    }
+    s_outbox_open = false;
+    s_outbox_sent += 1;
+    s_num_sent_values = 0;
+    for (int i = 0; i < s_outbox.num_tuples; i += 1) {
+        s_sent_keys[i] = s_outbox.tuples[i].key;
+        s_sent_values[i] = s_outbox.tuples[i].value->int32;
+        s_num_sent_values += 1;
+    }
+    return APP_MSG_OK;
+}
+
+void stub_outbox_fail(AppMessageResult reason) {
+    if (s_outbox_failed != NULL) {
+        s_outbox_failed(&s_outbox, reason, NULL);
+    }
+}
+
+int stub_outbox_sent(void) {
+    return s_outbox_sent;
+}
+
+int32_t stub_outbox_last_int(uint32_t key, int32_t otherwise) {
+    for (int i = 0; i < s_num_sent_values; i += 1) {
+        if ((uint32_t)s_sent_keys[i] == key) {
+            return s_sent_values[i];
+        }
+    }
+    return otherwise;
+}
+
+// services
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler) {
+}
+
+void tick_timer_service_unsubscribe(void) {
+}
+
+#define MAX_TIMERS 8
+
+struct AppTimer {
+    uint32_t timeout_ms;
+    AppTimerCallback callback;
+    void* callback_data;
+    bool pending;
+};
+
+static AppTimer s_timers[MAX_TIMERS];
+static int s_timers_registered = 0;
+
+AppTimer* app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void* callback_data) {
+    for (int i = 0; i < MAX_TIMERS; i += 1) {
+        if (!s_timers[i].pending) {
+            s_timers_registered += 1;
+            s_timers[i] = (AppTimer) {
+                .timeout_ms = timeout_ms,
+                .callback = callback,
+                .callback_data = callback_data,
+                .pending = true,
+            };
+            return &s_timers[i];
+        }
+    }
+    return NULL;
+}
+
+void app_timer_cancel(AppTimer* timer_handle) {
+    if (timer_handle != NULL) {
+        timer_handle->pending = false;
+    }
+}
+
+int stub_timers_pending(void) {
+    int count = 0;
+    for (int i = 0; i < MAX_TIMERS; i += 1) {
+        count += s_timers[i].pending ? 1 : 0;
+    }
+    return count;
+}
+
+int stub_timers_registered(void) {
+    return s_timers_registered;
+}
+
+bool stub_timer_fire_next(void) {
+    AppTimer* soonest = NULL;
+    for (int i = 0; i < MAX_TIMERS; i += 1) {
+        if (s_timers[i].pending && (soonest == NULL || s_timers[i].timeout_ms < soonest->timeout_ms)) {
+            soonest = &s_timers[i];
+        }
+    }
+    if (soonest == NULL) {
+        return false;
+    }
+    soonest->pending = false;
+    soonest->callback(soonest->callback_data);
+    return true;
+}
+
+BatteryChargeState battery_state_service_peek(void) {
+    return (BatteryChargeState) {
+        .charge_percent = 80,
+        .is_charging = false,
+        .is_plugged = false,
+    };
+}
+
+bool connection_service_peek_pebble_app_connection(void) {
+    return true;
+}
+
+void connection_service_subscribe(ConnectionHandlers conn_handlers) {
+}
+
+void connection_service_unsubscribe(void) {
+}
+
+void vibes_short_pulse(void) {
+}
+
+void app_event_loop(void) {
+}
+
+// persistent storage
+
+#define MAX_PERSIST_KEYS 32
+#define E_DOES_NOT_EXIST -4
+
+typedef struct {
+    bool used;
+    uint32_t key;
+    size_t length;
+    uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} PersistEntry;
+
+static PersistEntry s_persist[MAX_PERSIST_KEYS];
+
+static PersistEntry* persist_find(uint32_t key, bool create) {
+    PersistEntry* free_entry = NULL;
+    for (int i = 0; i < MAX_PERSIST_KEYS; i += 1) {
+        if (s_persist[i].used && s_persist[i].key == key) {
+            return &s_persist[i];
+        }
+        if (!s_persist[i].used && free_entry == NULL) {
+            free_entry = &s_persist[i];
+        }
+    }
+    if (create && free_entry != NULL) {
+        *free_entry = (PersistEntry) {
+            .used = true,
+            .key = key,
+        };
+        return free_entry;
+    }
+    return NULL;
+}
+
+bool persist_exists(const uint32_t key) {
+    return persist_find(key, false) != NULL;
+}
+
+int32_t persist_read_int(const uint32_t key) {
+    PersistEntry* entry = persist_find(key, false);
+    int32_t value = 0;
+    if (entry != NULL && entry->length == sizeof(value)) {
+        memcpy(&value, entry->data, sizeof(value));
+    }
+    return value;
+}
+
+int persist_read_data(const uint32_t key, void* buffer, const size_t buffer_size) {
+    PersistEntry* entry = persist_find(key, false);
+    if (entry == NULL) {
+        return E_DOES_NOT_EXIST;
+    }
+    const size_t length = entry->length < buffer_size ? entry->length : buffer_size;
+    memcpy(buffer, entry->data, length);
+    return (int)length;
+}
+
+int persist_write_int(const uint32_t key, const int32_t value) {
+    return persist_write_data(key, &value, sizeof(value));
+}
+
+int persist_write_data(const uint32_t key, const void* data, const size_t size) {
+    PersistEntry* entry = persist_find(key, true);
+    if (entry == NULL) {
+        return E_DOES_NOT_EXIST;
+    }
+    entry->length = size < PERSIST_DATA_MAX_LENGTH ? size : PERSIST_DATA_MAX_LENGTH;
+    memcpy(entry->data, data, entry->length);
+    return (int)entry->length;
+}
+
+int persist_delete(const uint32_t key) {
+    PersistEntry* entry = persist_find(key, false);
+    if (entry == NULL) {
+        return E_DOES_NOT_EXIST;
+    }
+    entry->used = false;
+    return 0;
+}
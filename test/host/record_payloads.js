@@ -0,0 +1,63 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+// Encodes test/fixtures/watch_departures.json into the messages the
+// phone would send, for the host benchmark to replay. Run it again
+// whenever the message format changes:
+//
+//     node test/host/record_payloads.js
+
+const fs = require('fs');
+const path = require('path');
+const { encode_snapshot, encode_delta, fit_string_pool, WINDOW_SIZE } = require('../../src/pkjs/message');
+
+const fixture = JSON.parse(fs.readFileSync(path.join(__dirname, '../fixtures/watch_departures.json')));
+const out_dir = path.join(__dirname, 'payloads');
+
+function watch_data(departure, minutes_later) {
+    const arrival = (minutes) => fixture.recorded_at + (minutes - minutes_later) * 60;
+    return Object.assign({}, departure, {
+        "arrival": arrival(departure.minutes),
+        "next_arrivals": departure.next_minutes.map(arrival),
+    });
+}
+
+function write(name, bytes) {
+    fs.writeFileSync(path.join(out_dir, name), Buffer.from(bytes));
+    console.log(name + ": " + bytes.length + " bytes");
+}
+
+const all = fixture.departures;
+const total = all.length;
+const first_window = all.slice(0, WINDOW_SIZE).map((departure) => watch_data(departure, 0));
+// a minute later: only the times moved
+const first_window_later = all.slice(0, WINDOW_SIZE).map((departure) => watch_data(departure, 1));
+// scrolled far enough to ask for the next window
+const page_offset = WINDOW_SIZE / 2;
+const second_window = all.slice(page_offset, page_offset + WINDOW_SIZE).map((departure) => watch_data(departure, 1));
+
+// more than the watch's string pool holds: nothing shared, and every
+// string as long as the phone will send
+const long_window = first_window.map((departure, index) => {
+    let result = Object.assign({}, departure);
+    for (const field of ["unit", "stop_name", "dest_name", "route_number", "route_name"]) {
+        result[field] = (index + " " + field + " " + departure[field]).padEnd(40, ".");
+    }
+    return result;
+});
+
+// a phone bug the watch has to refuse: two departures with the same id
+const duplicate_ids = first_window.map((departure, index) =>
+    index == 1 ? Object.assign({}, departure, { "id": first_window[0].id }) : departure);
+
+const header = (offset) => ({ "partial": false, "more": false, "offset": offset, "total": total });
+write('snapshot.bin', encode_snapshot(1, first_window, header(0)));
+write('snapshot_long_strings.bin', encode_snapshot(1, long_window, header(0)));
+write('snapshot_long_strings_fitted.bin', encode_snapshot(1, fit_string_pool(long_window), header(0)));
+write('delta_long_strings.bin', encode_delta(1, 2, first_window, long_window, header(0)));
+write('snapshot_duplicate_ids.bin', encode_snapshot(1, duplicate_ids, header(0)));
+write('delta_times.bin', encode_delta(1, 2, first_window, first_window_later, header(0)));
+write('delta_page.bin', encode_delta(2, 3, first_window_later, second_window, header(page_offset)));
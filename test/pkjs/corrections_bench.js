@@ -0,0 +1,122 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+// Times the operator corrections over the TransSee response in
+// test/fixtures/transsee_predictions.json, for the compiled rule tables
+// against the per-agency functions they replaced (kept in
+// operator_corrections_before.js), and checks that both correct every
+// departure the same way:
+//
+//     node test/pkjs/corrections_bench.js
+//
+// BENCH_ITERATIONS sets how many refreshes are timed.
+
+const assert = require('assert');
+const fs = require('fs');
+const Module = require('module');
+const path = require('path');
+const { VehicleType, RouteShape } = require('../../src/pkjs/data');
+
+const OLD_PATH = path.join(__dirname, 'operator_corrections_before.js');
+const NEW_PATH = path.join(__dirname, '../../src/pkjs/operator_corrections.js');
+const ITERATIONS = parseInt(process.env.BENCH_ITERATIONS || "20000");
+// fresh copies of the module loaded to time the first refresh
+const COLD_LOADS = 200;
+
+// a fresh copy of the module, without going through the require cache
+function load_source(source, filename) {
+    let module = new Module(filename, null);
+    module.filename = filename;
+    module.paths = Module._nodeModulePaths(path.dirname(filename));
+    module._compile(source, filename);
+    return module.exports;
+}
+
+// the departures index.js makes from the response, before they're corrected
+function departures(fixture) {
+    let result = [];
+    for (const { stop, predictions } of fixture.stops) {
+        for (const route of predictions) {
+            for (const direction of route.direction || []) {
+                if (direction.prediction.length == 0) {
+                    continue;
+                }
+                result.push({ "stop": stop, "route": route, "direction": direction.title, "prediction": direction.prediction[0] });
+            }
+        }
+    }
+    return result;
+}
+
+function refresh(apply, deps) {
+    return deps.map(({ stop, route, direction, prediction }) => {
+        let watch_data = {
+            "stop_name": stop.stop_name,
+            "dest_name": direction,
+            "route_number": route.routeTag,
+            "route_name": route.routeTitle.replace(route.routeTag + "-", ""),
+            "vehicle_type": VehicleType.BUS,
+            "shape": RouteShape.ROUNDRECT,
+        };
+        apply(stop, route, direction, prediction, watch_data);
+        return watch_data;
+    });
+}
+
+function time_us(fn, iterations) {
+    const start = process.hrtime.bigint();
+    for (let i = 0; i < iterations; i += 1) {
+        fn();
+    }
+    return Number(process.hrtime.bigint() - start) / iterations / 1000;
+}
+
+// the first refresh after the app starts, module load included
+function time_cold_us(source, filename, apply_of, deps) {
+    return time_us(() => refresh(apply_of(load_source(source, filename)), deps), COLD_LOADS);
+}
+
+function main() {
+    const fixture = JSON.parse(fs.readFileSync(path.join(__dirname, '../fixtures/transsee_predictions.json')));
+    const deps = departures(fixture);
+    const old_source = fs.readFileSync(OLD_PATH, 'utf8');
+    const new_source = fs.readFileSync(NEW_PATH, 'utf8');
+
+    const old_apply_of = (corrections) => function(stop, route, direction, prediction, watch_data) {
+        if (corrections.transsee.hasOwnProperty(route.agencyTitle)) {
+            corrections.transsee[route.agencyTitle](stop, route, direction, prediction, watch_data);
+        }
+    };
+    const new_apply_of = (corrections) => corrections.apply_transsee;
+    const old_apply = old_apply_of(load_source(old_source, OLD_PATH));
+    const new_apply = new_apply_of(load_source(new_source, NEW_PATH));
+
+    // the second pass goes through the memoised results
+    const expected = refresh(old_apply, deps);
+    for (let pass = 0; pass < 2; pass += 1) {
+        refresh(new_apply, deps).forEach((watch_data, i) => {
+            assert.deepStrictEqual(watch_data, expected[i],
+                "pass " + pass + ": " + deps[i].route.agencyTitle + " " + deps[i].route.routeTag + " " + deps[i].direction);
+        });
+    }
+
+    // warm up before timing
+    time_us(() => refresh(old_apply, deps), ITERATIONS / 10);
+    time_us(() => refresh(new_apply, deps), ITERATIONS / 10);
+    const old_cold = time_cold_us(old_source, OLD_PATH, old_apply_of, deps);
+    const new_cold = time_cold_us(new_source, NEW_PATH, new_apply_of, deps);
+    const old_warm = time_us(() => refresh(old_apply, deps), ITERATIONS);
+    const new_warm = time_us(() => refresh(new_apply, deps), ITERATIONS);
+
+    const agencies = new Set(deps.map((dep) => dep.route.agencyTitle));
+    console.log(deps.length + " departures from " + fixture.stops.length + " stops (" + [...agencies].join(", ")
+        + "), corrected the same way by both");
+    console.log("per refresh               before        after");
+    console.log("first, with load      " + old_cold.toFixed(1).padStart(10) + " us" + new_cold.toFixed(1).padStart(10) + " us");
+    console.log("every one after       " + old_warm.toFixed(1).padStart(10) + " us" + new_warm.toFixed(1).padStart(10) + " us");
+}
+
+main();
@@ -0,0 +1,327 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+// Runs the phone app from 'ready' to the last message it sends the watch,
+// against a local server standing in for the stops API and TransSee that
+// answers some stops slowly, some with errors and some not at all, and
+// checks that the watch hears back within the fetch deadline. Also checks
+// which of the watch's later requests fetch again:
+//
+//     node test/pkjs/fetch_deadline_test.js
+//
+// Set TEST_LOG to see the app's own logging.
+
+const assert = require('assert');
+const fs = require('fs');
+const http = require('http');
+const Module = require('module');
+const path = require('path');
+
+const SRC_DIR = path.join(__dirname, '../../src/pkjs');
+const index_source = fs.readFileSync(path.join(SRC_DIR, 'index.js'), 'utf8');
+const FETCH_DEADLINE_MS = parseInt(index_source.match(/const FETCH_DEADLINE_MS = (\d+);/)[1]);
+// time allowed past the deadline for ranking, encoding and timer jitter
+const SLACK_MS = 750;
+// the first departures should be on screen as soon as any stop answers
+const FIRST_MESSAGE_MS = 1000;
+
+const KEYS = { "num_routes": 0, "departures": 1, "seq": 2, "page_offset": 3, "needs_snapshot": 4 };
+// apikey.js isn't checked in, and message_keys comes from the Pebble build
+const load = Module._load;
+Module._load = function(request, ...rest) {
+    if (request == "./apikey") {
+        return { "TRANSSEE_USERID": "test" };
+    } else if (request == "message_keys") {
+        return KEYS;
+    }
+    return load.call(this, request, ...rest);
+};
+const MessageType = { "SNAPSHOT": 0, "DELTA": 1 };
+const MessageFlag = { "PARTIAL": 1, "MORE": 2 };
+const HERE = { "latitude": 43.6578, "longitude": -79.4001 };
+
+// how the mock TransSee answers each stop, by stop code
+const Behaviour = {
+    "FAST": "fast",
+    // answers, but only after SLOWISH_MS
+    "SLOWISH": "slowish",
+    // never answers
+    "HANGS": "hangs",
+    "ERROR_500": "error_500",
+    // drops the connection
+    "DROPS": "drops",
+    // drops the connection the first time, then answers
+    "FLAKY": "flaky",
+};
+const SLOWISH_MS = 1500;
+
+let s_stops = [];
+let s_requests = new Map();
+
+function predictions_for(stop_code) {
+    const now_ms = Date.now();
+    return {
+        "predictions": [{
+            "routeTag": stop_code,
+            "stopTag": stop_code,
+            "routeTitle": stop_code + "-Route " + stop_code,
+            "agencyTitle": "Mock",
+            "direction": [{
+                "title": "Towards " + stop_code,
+                "prediction": [2, 9, 17].map((minutes) => ({
+                    "minutes": String(minutes),
+                    "epochTime": String(now_ms + minutes * 60 * 1000),
+                })),
+            }],
+        }],
+    };
+}
+
+function answer(response, body) {
+    response.writeHead(200, { "Content-Type": "application/json" });
+    response.end(JSON.stringify(body));
+}
+
+function handle(request, response) {
+    const url = new URL(request.url, "http://localhost");
+    if (url.pathname.startsWith("/stops.david.industries/")) {
+        answer(response, s_stops);
+        return;
+    }
+    const stop_code = url.searchParams.get("stopId");
+    const attempt = (s_requests.get(stop_code) || 0) + 1;
+    s_requests.set(stop_code, attempt);
+    const stop = s_stops.find((stop) => stop.stop_code == stop_code);
+    switch (stop.behaviour) {
+        case Behaviour.FAST:
+            answer(response, predictions_for(stop_code));
+            break;
+        case Behaviour.SLOWISH:
+            setTimeout(() => answer(response, predictions_for(stop_code)), SLOWISH_MS);
+            break;
+        case Behaviour.HANGS:
+            break;
+        case Behaviour.ERROR_500:
+            response.writeHead(500);
+            response.end("Server error");
+            break;
+        case Behaviour.DROPS:
+            request.socket.destroy();
+            break;
+        case Behaviour.FLAKY:
+            if (attempt == 1) {
+                request.socket.destroy();
+            } else {
+                answer(response, predictions_for(stop_code));
+            }
+            break;
+    }
+}
+
+function make_stops(behaviours) {
+    return behaviours.map((behaviour, i) => ({
+        "agency": "ttc",
+        "stop_id": String(9000 + i),
+        "stop_code": behaviour + i,
+        "stop_name": "Mock Stop " + i,
+        "stop_lat": HERE.latitude + i * 0.0005,
+        "stop_lon": HERE.longitude,
+        "behaviour": behaviour,
+    }));
+}
+
+// errors are sent by key name, departures by key number
+function is_error(message) {
+    return message.dict.hasOwnProperty("num_routes");
+}
+
+function decode_header(bytes) {
+    return {
+        "type": bytes[1],
+        "seq": bytes[2] | (bytes[3] << 8),
+        "flags": bytes[4],
+        "total": bytes[7] | (bytes[8] << 8),
+    };
+}
+
+// a fresh copy of the app, talking to the mock server on `port`
+function load_app(port) {
+    for (const cached of Object.keys(require.cache)) {
+        if (cached.startsWith(SRC_DIR)) {
+            delete require.cache[cached];
+        }
+    }
+    let handlers = {};
+    let messages = [];
+    let storage = new Map();
+    global.Pebble = {
+        "addEventListener": (name, handler) => handlers[name] = handler,
+        "sendAppMessage": (dict, success) => {
+            messages.push({ "at": Date.now(), "dict": dict });
+            setImmediate(success);
+        },
+    };
+    global.localStorage = {
+        "getItem": (key) => storage.has(key) ? storage.get(key) : null,
+        "setItem": (key, value) => storage.set(key, String(value)),
+    };
+    Object.defineProperty(global, "navigator", {
+        "configurable": true,
+        "value": { "geolocation": { "getCurrentPosition": (success) => success({ "coords": HERE }) } },
+    });
+    global.fetch = (url) => {
+        const target = new URL(String(url));
+        return real_fetch("http://127.0.0.1:" + port + "/" + target.hostname + target.pathname + target.search);
+    };
+    require(path.join(SRC_DIR, 'index.js'));
+    return { "handlers": handlers, "messages": messages };
+}
+
+function wait_for(condition, timeout_ms) {
+    return new Promise((resolve, reject) => {
+        const started = Date.now();
+        const poll = setInterval(() => {
+            if (condition()) {
+                clearInterval(poll);
+                resolve();
+            } else if (Date.now() - started > timeout_ms) {
+                clearInterval(poll);
+                reject(new Error("Timed out waiting for the app"));
+            }
+        }, 10);
+    });
+}
+
+/*
+Start the app with stops answering as `behaviours` says and wait for its
+last message: an error, or departures with nothing more coming. Returns
+{ elapsed_ms, first_ms, last, messages, app }.
+*/
+async function run(port, behaviours) {
+    s_stops = make_stops(behaviours);
+    s_requests = new Map();
+    const app = load_app(port);
+    const is_last = (message) => is_error(message) || !(decode_header(message.dict[KEYS.departures]).flags & MessageFlag.MORE);
+    const started = Date.now();
+    app.handlers.ready();
+    await wait_for(() => app.messages.some(is_last), FETCH_DEADLINE_MS * 3);
+    const last = app.messages.find(is_last);
+    return {
+        "elapsed_ms": last.at - started,
+        "first_ms": app.messages[0].at - started,
+        "last": last,
+        "messages": app.messages,
+        "app": app,
+    };
+}
+
+// later messages are deltas that only carry changed records, so look through them all
+function transsee_requests() {
+    return [...s_requests.values()].reduce((sum, count) => sum + count, 0);
+}
+
+/*
+Send the watch's `payload` to the app and wait for its reply. Returns
+the reply and whether TransSee was asked again for it.
+*/
+async function ask(app, payload) {
+    const sent = app.messages.length;
+    const requests = transsee_requests();
+    app.handlers.appmessage({ "payload": payload });
+    await wait_for(() => app.messages.length > sent, FETCH_DEADLINE_MS * 3);
+    return { "reply": app.messages[sent], "fetched": transsee_requests() > requests };
+}
+
+function routes_sent(result, stops) {
+    const text = result.messages.filter((message) => message.dict.hasOwnProperty(KEYS.departures))
+        .map((message) => Buffer.from(message.dict[KEYS.departures]).toString('latin1').toLowerCase())
+        .join("");
+    return stops.filter((stop) => text.includes(stop.stop_code)).map((stop) => stop.behaviour);
+}
+
+const real_fetch = globalThis.fetch;
+
+// failed fetches are passed on after the error has gone to the watch, and
+// PebbleKit JS only logs them, so don't let Node exit over them
+process.on("unhandledRejection", (e) => {
+    if (e.error_code === undefined) {
+        throw e;
+    }
+});
+
+async function main() {
+    const log = console.log;
+    if (!process.env.TEST_LOG) {
+        console.log = () => {};
+    }
+    const server = http.createServer(handle);
+    await new Promise((resolve) => server.listen(0, "127.0.0.1", resolve));
+    const port = server.address().port;
+    let report = [];
+
+    // every stop answers straight away
+    let result = await run(port, [Behaviour.FAST, Behaviour.FAST, Behaviour.FAST, Behaviour.FAST]);
+    let header = decode_header(result.last.dict[KEYS.departures]);
+    assert.strictEqual(header.flags & MessageFlag.PARTIAL, 0, "all stops answered but the result is partial");
+    assert.strictEqual(header.total, 4);
+    assert.ok(result.elapsed_ms < FIRST_MESSAGE_MS, "healthy stops took " + result.elapsed_ms + " ms");
+    report.push("all fast: " + result.elapsed_ms + " ms");
+
+    // a watch that couldn't apply a delta gets the last list again without a fetch
+    let answer = await ask(result.app, { "seq": 0, "needs_snapshot": 1 });
+    assert.ok(!answer.fetched, "a snapshot request fetched again");
+    assert.strictEqual(decode_header(answer.reply.dict[KEYS.departures]).type, MessageType.SNAPSHOT);
+    // the watch retrying after an error also has seq 0, but wants fresh departures
+    answer = await ask(result.app, { "seq": 0 });
+    assert.ok(answer.fetched, "a refresh after an error didn't fetch");
+    assert.strictEqual(decode_header(answer.reply.dict[KEYS.departures]).type, MessageType.SNAPSHOT);
+    // a page asked for while a message is still going out is sent against
+    // that message, which the watch will have by then
+    const watch_seq = decode_header(answer.reply.dict[KEYS.departures]).seq;
+    const sent = result.app.messages.length;
+    result.app.handlers.appmessage({ "payload": { "seq": watch_seq, "needs_snapshot": 1 } });
+    answer = await ask(result.app, { "seq": watch_seq, "page_offset": 0 });
+    assert.strictEqual(result.app.messages.length, sent + 2);
+    const page = decode_header(result.app.messages[sent + 1].dict[KEYS.departures]);
+    assert.strictEqual(page.type, MessageType.DELTA, "a queued page was sent as a snapshot");
+
+    // a mix: the answers that arrive by the deadline are sent, marked partial
+    const mixed = [Behaviour.FAST, Behaviour.SLOWISH, Behaviour.HANGS, Behaviour.ERROR_500, Behaviour.DROPS, Behaviour.FLAKY];
+    result = await run(port, mixed);
+    header = decode_header(result.last.dict[KEYS.departures]);
+    assert.ok(result.elapsed_ms <= FETCH_DEADLINE_MS + SLACK_MS,
+        "took " + result.elapsed_ms + " ms, the deadline is " + FETCH_DEADLINE_MS + " ms");
+    assert.ok(result.first_ms < FIRST_MESSAGE_MS, "first departures took " + result.first_ms + " ms");
+    assert.ok(decode_header(result.messages[0].dict[KEYS.departures]).flags & MessageFlag.MORE);
+    assert.ok(header.flags & MessageFlag.PARTIAL, "missing stops but the result isn't partial");
+    assert.strictEqual(header.total, 3);
+    assert.deepStrictEqual(routes_sent(result, s_stops), [Behaviour.FAST, Behaviour.SLOWISH, Behaviour.FLAKY]);
+    assert.strictEqual(s_requests.get(s_stops[5].stop_code), 2, "the flaky stop wasn't retried");
+    report.push("slow and failing: first departures " + result.first_ms + " ms, all " + result.elapsed_ms
+        + " ms (" + result.messages.length + " messages)");
+
+    // nothing answers: the watch gets an error, without waiting out the deadline
+    result = await run(port, [Behaviour.ERROR_500, Behaviour.DROPS]);
+    assert.ok(is_error(result.last), "expected an error message");
+    assert.ok(result.last.dict.num_routes < 0);
+    assert.ok(result.elapsed_ms < FIRST_MESSAGE_MS, "the error took " + result.elapsed_ms + " ms");
+    report.push("all failing: error after " + result.elapsed_ms + " ms");
+
+    // one stop hangs and nothing else answers: an error at the deadline
+    result = await run(port, [Behaviour.HANGS, Behaviour.DROPS]);
+    assert.ok(is_error(result.last), "expected an error message");
+    assert.ok(result.elapsed_ms <= FETCH_DEADLINE_MS + SLACK_MS, "the error took " + result.elapsed_ms + " ms");
+    report.push("hanging and failing: error after " + result.elapsed_ms + " ms");
+
+    server.closeAllConnections();
+    server.close();
+    log("fetch deadline " + FETCH_DEADLINE_MS + " ms\n    " + report.join("\n    "));
+}
+
+main().catch((e) => {
+    console.error(e);
+    process.exit(1);
+});
@@ -0,0 +1,145 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at https://mozilla.org/MPL/2.0/.
+*/
+
+// Builds the offline stop index from test/fixtures/gtfs/stops.txt and a
+// generated feed, and checks nearest() against a brute force search:
+//
+//     node test/pkjs/stop_index_test.js
+
+const assert = require('assert');
+const fs = require('fs');
+const path = require('path');
+const { distance_m } = require('../../src/pkjs/geo');
+
+let storage = new Map();
+global.localStorage = {
+    "getItem": (key) => storage.has(key) ? storage.get(key) : null,
+    "setItem": (key, value) => storage.set(key, String(value)),
+};
+let feeds = new Map();
+global.fetch = async (url) => ({ "text": async () => feeds.get(url) });
+const stop_index = require('../../src/pkjs/stop_index');
+
+// Spadina and College
+const LAT = 43.6578;
+const LON = -79.4001;
+const MAX_RADIUS_M = 5000;
+
+// a small LCG, so the generated feed is the same every run
+let seed = 1;
+function random() {
+    seed = (seed * 1103515245 + 12345) % 2147483648;
+    return seed / 2147483648;
+}
+
+// the index keeps coordinates to 1e-5 degrees
+function stored(degrees) {
+    return Math.round(degrees * 100000) / 100000;
+}
+
+/*
+Stops scattered over about 20 km around downtown, some sharing a spot;
+`stops` gets them as the index will return them
+*/
+function generated_feed(agency, count, stops) {
+    let lines = ["stop_id,stop_name,stop_lat,stop_lon"];
+    for (let i = 0; i < count; i += 1) {
+        const lat = (i % 50 == 0 ? LAT : LAT + (random() - 0.5) * 0.18).toFixed(6);
+        const lon = (i % 50 == 0 ? LON : LON + (random() - 0.5) * 0.25).toFixed(6);
+        lines.push(["g" + i, "Generated " + i, lat, lon].join(","));
+        stops.push({ "agency": agency, "stop_id": "g" + i, "stop_lat": stored(lat), "stop_lon": stored(lon) });
+    }
+    return lines.join("\n");
+}
+
+function brute_force(stops, lat, lon, k) {
+    return stops.map((stop) => [distance_m(lat, lon, stop.stop_lat, stop.stop_lon), stop])
+        .filter(([distance]) => distance <= MAX_RADIUS_M)
+        .sort((a, b) => a[0] - b[0])
+        .slice(0, k);
+}
+
+function key(stop) {
+    return stop.agency + "|" + stop.stop_id;
+}
+
+async function main() {
+    assert.strictEqual(stop_index.available(), false);
+    assert.strictEqual(stop_index.age_ms(), Infinity);
+    assert.deepStrictEqual(stop_index.nearest(LAT, LON, 5), []);
+
+    feeds.set("fixture", fs.readFileSync(path.join(__dirname, '../fixtures/gtfs/stops.txt'), 'utf8'));
+    let generated_stops = [];
+    feeds.set("generated", generated_feed("gen", 4000, generated_stops));
+    await stop_index.rebuild([
+        { "agency": "ttc", "url": "fixture" },
+        { "agency": "gen", "url": "generated" },
+    ]);
+    assert.strictEqual(stop_index.available(), true);
+    assert.ok(stop_index.age_ms() < 60 * 1000);
+
+    // the fixture's awkward rows
+    const fixture_stops = stop_index.nearest(LAT, LON, 100000).filter((stop) => stop.agency == "ttc");
+    const by_id = new Map(fixture_stops.map((stop) => [stop.stop_id, stop]));
+    assert.strictEqual(by_id.size, 20, "fixture stops in range: " + [...by_id.keys()]);
+    assert.strictEqual(by_id.get("1005").stop_name, "Spadina Ave At Nassau St, Kensington Market");
+    assert.strictEqual(by_id.get("1005").stop_code, "1005", "missing stop_code falls back to stop_id");
+    assert.strictEqual(by_id.get("1006").stop_name, 'College St At Augusta Ave ("Kensington")');
+    assert.strictEqual(by_id.get("1021").stop_code, "7008", "row after a multi-line field");
+    assert.strictEqual(by_id.get("14002").stop_name, "Spadina Station - Line 1, Southbound Platform");
+    for (const skipped of ["14000", "14001", "1019", "1020", "1022"]) {
+        assert.ok(!by_id.has(skipped), skipped + " shouldn't be a nearby stop");
+    }
+    assert.strictEqual(by_id.get("1001").stop_lat, 43.65793);
+    assert.strictEqual(by_id.get("1001").stop_lon, -79.39995);
+
+    // stops either side of a cell boundary are both found
+    const boundary = stop_index.nearest(43.660015, -79.400000, 2).map((stop) => stop.stop_id).sort();
+    assert.deepStrictEqual(boundary, ["1012", "1013"]);
+
+    // out of range of everything but the lone stop in Hamilton
+    assert.deepStrictEqual(stop_index.nearest(43.2540, -79.8700, 3).map(key), ["ttc|1022"]);
+    assert.deepStrictEqual(stop_index.nearest(45.0, -75.0, 3), []);
+
+    // every stop, as the index stores them, for the brute force search
+    const all = fixture_stops.concat(generated_stops);
+    let queries = 0;
+    for (let i = 0; i < 300; i += 1) {
+        const lat = LAT + (random() - 0.5) * 0.1;
+        const lon = LON + (random() - 0.5) * 0.14;
+        for (const k of [1, 9, 40]) {
+            const expected = brute_force(all, lat, lon, k);
+            const actual = stop_index.nearest(lat, lon, k);
+            assert.strictEqual(actual.length, expected.length);
+            actual.forEach((stop, j) => {
+                // ties can come back in either order, but at the same distance
+                const distance = distance_m(lat, lon, stop.stop_lat, stop.stop_lon);
+                assert.ok(Math.abs(distance - expected[j][0]) < 1e-6,
+                    "query " + i + " k " + k + " result " + j + ": " + distance + " m, expected " + expected[j][0] + " m");
+            });
+            queries += 1;
+        }
+    }
+
+    // a fresh start reads the index back out of localStorage
+    const stored = storage.get("stop_index");
+    delete require.cache[require.resolve('../../src/pkjs/stop_index')];
+    const reloaded = require('../../src/pkjs/stop_index');
+    assert.deepStrictEqual(reloaded.nearest(LAT, LON, 9), stop_index.nearest(LAT, LON, 9));
+
+    // and ignores one that can't be read
+    storage.set("stop_index", stored.slice(0, 100));
+    delete require.cache[require.resolve('../../src/pkjs/stop_index')];
+    const corrupt = require('../../src/pkjs/stop_index');
+    assert.strictEqual(corrupt.available(), false);
+
+    console.log("stop index: " + all.length + " stops, " + queries + " queries match brute force");
+}
+
+main().catch((e) => {
+    console.error(e);
+    process.exit(1);
+});
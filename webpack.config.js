@@ -19,7 +19,12 @@ module.exports = {
     './src/pkjs/index.js',
     './src/pkjs/apikey.js',
     './src/pkjs/data.js',
+    './src/pkjs/geo.js',
+    './src/pkjs/message.js',
     './src/pkjs/operator_corrections.js',
+    './src/pkjs/ranking.js',
+    './src/pkjs/stop_cache.js',
+    './src/pkjs/stop_index.js',
     './src/pkjs/title_caps.js'
   ],
   output: {